@@ -19,6 +19,7 @@ public:
 	static bool checkSymbolicList(std::string* s);
 	static bool isNumber(std::string string);
 	static void printHex(std::ostream& os, uint32_t number, int width, bool prefix = false);
+	static uint32_t hashString(const std::string& string);
 };
 
 
@@ -0,0 +1,57 @@
+#ifndef AOTRUNTIME_H
+#define AOTRUNTIME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unordered_map>
+#include <atomic>
+#include "ComputerSystem.hpp"
+#include "BlockCache.hpp"
+#include "JitCompiler.hpp"
+
+/*
+  Runtime side of ahead of time translation
+  Translator turns every block it finds in an executable into a C++ function with the same signature and exit values
+  as JIT compiled code, generated file is built together with the emulator sources and registers its blocks here
+  Block cache attaches a function to a freshly translated block only if the guest words it was generated from are
+  still in memory, so self modifying code and other programs just run interpreted
+*/
+
+// Block translated by the translator tool
+struct AotBlock {
+  uint32_t start;             // Guest address of the first instruction
+  uint32_t size;              // Number of guest instructions
+  uint32_t length;            // Number of words in words, word after a pop into PC is included as well
+  const uint32_t* words;      // Guest code the function was generated from
+  JitFunction function;
+};
+
+class AotRuntime {
+
+  static std::unordered_map<uint32_t, const AotBlock*>& registry();
+  static std::atomic<uint64_t> attached;
+
+public:
+
+  static void add(const AotBlock* blocks, size_t count);
+  static bool empty() { return registry().empty(); }
+
+  // Sets block.native if there is a translated block with the same start and contents
+  static bool attach(Block& block, const Memory& memory);
+
+  static uint64_t getRegistered() { return registry().size(); }
+  static uint64_t getAttached() { return attached; }
+
+};
+
+// Generated file defines one of these, so blocks are registered before main runs
+struct AotRegistration {
+  AotRegistration(const AotBlock* blocks, size_t count) { AotRuntime::add(blocks, count); }
+};
+
+// Memory access from generated code, same slow paths JIT helpers use
+// Write returns non zero if the store hit translated code
+uint32_t aotReadWord(void* context, uint32_t address);
+uint32_t aotWriteWord(void* context, uint32_t address, uint32_t word);
+
+#endif
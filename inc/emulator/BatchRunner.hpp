@@ -0,0 +1,71 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include "Emulator.hpp"
+
+// Default number of instructions a single batch program can take before it is stopped
+#define BATCH_LIMIT   1000000000ull
+
+// One line of the job list, executable with optional terminal input and output files
+struct BatchJob {
+  std::string executable;
+  std::string input;
+  std::string output;
+
+  bool halted = false;
+  uint64_t retired = 0;
+  std::string captured;
+  // Empty if the job ran and its output was written, otherwise why it didn't
+  std::string error;
+};
+
+/*
+  Batch runner
+  Runs every job from the list on a fresh machine, spread over a pool of worker threads
+  Each executable is loaded once and saved as a snapshot, workers map that snapshot copy on write, so pages which
+  programs don't write to(their code) are shared by all machines running the same executable
+  A job that can't be loaded or whose files can't be opened fails on its own, the other jobs still run
+*/
+class BatchRunner {
+
+  const Emulator& settings;
+  unsigned workers;
+  uint64_t limit;
+
+  std::vector<BatchJob> jobs;
+  std::atomic<size_t> next_job{0};
+  // Executable name to the snapshot it was saved to, and to the reason it couldn't be for those which failed
+  std::map<std::string, std::string> images;
+  std::map<std::string, std::string> image_errors;
+
+  void printError(std::string message) {
+    std::cout << "emulator: error : " << message << std::endl;
+    exit(-1);
+  }
+
+  void prepareImages();
+  void workerBody();
+
+public:
+
+  BatchRunner(const Emulator& settings, unsigned workers, uint64_t limit) : settings(settings), workers(workers), limit(limit) {};
+  BatchRunner(BatchRunner&) = delete;
+  void operator=(const BatchRunner&) = delete;
+  ~BatchRunner();
+
+  // Every line is "<executable> [<input-file>|- [<output-file>]]", empty lines and lines starting with # are skipped
+  void readJobs(std::string list_file);
+  void run();
+  // Prints a line per job, in list order, and a summary
+  void printResults(double seconds) const;
+
+};
+
+#endif
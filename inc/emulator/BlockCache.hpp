@@ -0,0 +1,108 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <stdlib.h>
+#include <string.h>
+#include "PageTable.hpp"
+#include "ComputerSystem.hpp"
+#include "DecodeCache.hpp"
+#include "LoopIdiom.hpp"
+
+// Maximum number of instructions in one translated block
+#define BLOCK_MAX_INSTRUCTIONS  128
+
+// Native code generated for a block, gets guest registers and an opaque context passed to helpers
+// Returns JIT_EXIT_NEXT, or the number of instructions that retired if a store made it leave the block early
+typedef uint32_t (*JitFunction)(uint32_t* gpr, void* context);
+
+// Sequence of instructions with a single entry, which ends with a control transfer, CSR write, or at the page boundary
+// Translated block is a list of decoded instructions(micro ops) terminated with an OP_BLOCK_END marker
+struct Block {
+  uint32_t start;                 // Guest address of the first instruction
+  uint32_t end;                   // Guest address right after the last instruction
+  uint32_t size;                  // Number of guest instructions
+  bool side_effects = false;      // Block writes to memory or CSRs, or raises an interrupt
+  uint64_t runs = 0;              // Number of times block was entered, for the instruction mix
+  std::vector<DecodedInstr> ops;
+
+  // Blocks that execution continued to after this one, so they can be entered without a lookup
+  // Index 0 is used for fall through successor and index 1 for any other
+  Block* link[2] = {};
+  uint32_t link_pc[2] = {};
+
+  // Number of times block was entered before it was compiled, and its native code if it was
+  uint32_t exec_count = 0;
+  JitFunction native = nullptr;
+
+  // Set if the block starts a copy, fill or compare loop
+  LoopIdiom* idiom = nullptr;
+
+  ~Block() { delete idiom; }
+
+  Block* successor(uint32_t pc) const {
+    if ( link[0] && link_pc[0] == pc ) return link[0];
+    if ( link[1] && link_pc[1] == pc ) return link[1];
+    return nullptr;
+  }
+
+  void chain(Block* next) {
+    int slot = next->start == end ? 0 : 1;
+    link[slot] = next;
+    link_pc[slot] = next->start;
+  }
+};
+
+// Translated blocks keyed by starting guest address
+class BlockCache {
+
+  std::unordered_map<uint32_t, Block*> blocks;
+  // One byte for every guest page, non zero if page holds at least one translated instruction
+  uint8_t* code_map;
+
+  void markCode(uint32_t address) { code_map[address >> PAGE_BITS] = 1; }
+
+  uint64_t translated = 0;
+  uint64_t flushes = 0;
+  // Instruction mix of blocks that were already dropped
+  uint64_t op_counts[OP_COUNT] = {};
+
+  static void countBlock(const Block& block, uint64_t* ops);
+
+public:
+
+  static bool endsBlock(const DecodedInstr& decoded);
+
+  BlockCache();
+  BlockCache(BlockCache&) = delete;
+  void operator=(const BlockCache&) = delete;
+  ~BlockCache();
+
+  Block* translate(const Memory& memory, uint32_t pc);
+
+  Block* get(const Memory& memory, uint32_t pc) {
+    auto it = blocks.find(pc);
+    return it != blocks.end() ? it->second : translate(memory, pc);
+  }
+
+  // True if the word written at address overlaps a translated instruction's page
+  bool isCode(uint32_t address) const {
+    return code_map[address >> PAGE_BITS] | code_map[(address + 3) >> PAGE_BITS];
+  }
+
+  const uint8_t* getCodeMap() const { return code_map; }
+
+  // Drops all translated blocks, links between blocks make dropping only some of them impractical
+  void flush();
+
+  // Adds the number of times every handler ran in blocks(each run counted as the whole block) to ops
+  void countOps(uint64_t* ops) const;
+
+  uint64_t getTranslated() const { return translated; }
+  uint64_t getFlushes() const { return flushes; }
+
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include "DecodeCache.hpp"
+#include "Profiler.hpp"
+
+/*
+  Call graph profiler
+  Shadow call stack follows the guest: call instructions push a frame for their target, and a pop pc that returns
+  to the address some frame was called from pops everything down to that frame. Every instruction is counted as
+  self cost of the frame on top, and a frame that is popped adds its inclusive cost to its caller
+  Interrupts push frames that have no caller, so handler time shows up on its own and not as part of the code that
+  was interrupted. Iret starts with pop pc, so it ends those frames the same way a return does
+*/
+class CallGraph {
+
+  // Entry frame is where tracking started, it has neither a caller nor a return address
+  // Interrupt frames can be returned from, but their cost isn't added to anything
+  enum { FRAME_ENTRY, FRAME_CALL, FRAME_INTERRUPT };
+
+  struct Frame {
+    uint32_t function;
+    uint32_t call_site;
+    uint32_t return_address;
+    int kind;
+    uint64_t self;
+    uint64_t children;
+  };
+
+  struct CallCost {
+    uint64_t count = 0;
+    uint64_t inclusive = 0;
+  };
+
+  struct FunctionCost {
+    uint64_t self = 0;
+    uint64_t interrupts = 0;      // Number of times it was entered by an interrupt
+    // Call site and callee to the cost of those calls
+    std::map<std::pair<uint32_t, uint32_t>, CallCost> calls;
+  };
+
+  enum { PENDING_NONE, PENDING_CALL, PENDING_RETURN };
+
+  std::vector<Frame> stack;
+  std::map<uint32_t, FunctionCost> functions;
+  uint64_t total = 0;
+
+  // Call or return seen on the previous instruction, its effect is known only from the next PC
+  int pending = PENDING_NONE;
+  uint32_t last_pc = 0;
+
+  void resolve(uint32_t pc);
+  void push(uint32_t function, uint32_t call_site, uint32_t return_address, int kind);
+  void pop();
+
+public:
+
+  CallGraph() {};
+  CallGraph(CallGraph&) = delete;
+  void operator=(const CallGraph&) = delete;
+
+  // Called before every instruction executes
+  void step(uint32_t pc, uint8_t op, uint8_t reg_A) {
+    if ( pending || stack.empty() ) resolve(pc);
+    stack.back().self++;
+    total++;
+    last_pc = pc;
+    if ( op == OP_CALL || op == OP_CALL_MEM ) pending = PENDING_CALL;
+    else if ( (op == OP_LD_POP && reg_A == PC) || op == OP_IRET ) pending = PENDING_RETURN;
+  }
+
+  // Called on interrupt entry, return_address is the PC pushed by the processor
+  void interrupted(uint32_t return_address, uint32_t handler);
+
+  // Frames still on the stack are ended first, names come from the profiler's symbols
+  bool writeCallgrind(std::string file_name, const Profiler& symbols);
+
+};
+
+#endif
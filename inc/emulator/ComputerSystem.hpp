@@ -2,7 +2,11 @@
 #define COMPUTERSYSTEM_H
 
 #include <stdint.h>
-#include <unordered_map>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <algorithm>
+#include "PageTable.hpp"
 
 #define FLAG_TR 0x1   // Timer
 #define FLAG_TL 0x2   // Terminal
@@ -28,24 +32,61 @@ enum {
 
 class Memory {
 
-  std::unordered_map<uint32_t, uint8_t> memory;
+  struct Page {
+    uint8_t bytes[PAGE_SIZE] = {};
+  };
+
+  PageTable<Page> pages;
+
+  // Reads from pages that were never written to are served from this page
+  static const Page zero_page;
+
+  // Dirty page tracking, once enabled every write sets the byte for its page(native code sets them itself)
+  // Copies of all pages taken at the checkpoint are kept, so dirty pages can be put back the way they were
+  uint8_t* dirty_map = nullptr;
+  PageTable<Page> checkpoint_pages;
+
+  const uint8_t* pageForRead(uint32_t address) const {
+    const Page* page = pages.find(address);
+    return page ? page->bytes : zero_page.bytes;
+  }
+
+  uint8_t* pageForWrite(uint32_t address) {
+    if ( dirty_map ) dirty_map[address >> PAGE_BITS] = 1;
+    return pages.get(address)->bytes;
+  }
+
+  // Word access can be done with a single copy if it doesn't cross the page boundary
+  static bool wordFitsPage(uint32_t address) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return (address & PAGE_MASK) <= PAGE_SIZE - 4;
+#else
+    return false;
+#endif
+  }
 
 public:
 
+  Memory() {};
+  Memory(Memory&) = delete;
+  void operator=(const Memory&) = delete;
+  ~Memory() { free(dirty_map); }
+
   uint8_t read(uint32_t address) const {
-    if ( memory.find(address) != memory.end() ) {
-      return memory.at(address);
-    }
-    return 0;
+    return pageForRead(address)[address & PAGE_MASK];
   }
 
   void write(uint32_t address, uint8_t byte) {
-    memory[address] = byte;
+    pageForWrite(address)[address & PAGE_MASK] = byte;
   }
 
   // Reads a word stored in little-endian format from memory
   uint32_t readWord(uint32_t address) const {
     uint32_t word = 0;
+    if ( wordFitsPage(address) ) {
+      memcpy(&word, pageForRead(address) + (address & PAGE_MASK), 4);
+      return word;
+    }
     for ( int i = 0; i < 4; i++) {
       word |= ((uint32_t)read(address + i) << i * 8);
     }
@@ -54,11 +95,133 @@ public:
 
   // Writes a word to memory in little-endian format
   void writeWord(uint32_t address, uint32_t word) {
+    if ( wordFitsPage(address) ) {
+      memcpy(pageForWrite(address) + (address & PAGE_MASK), &word, 4);
+      return;
+    }
     for ( int i = 0; i < 4; i++) {
       write(address + i, (word >> 8 * i) & 0xff );
     }
   }
 
+  // Page table for generated code, pages are arrays of PAGE_SIZE bytes
+  const void* rawPageDirectory() const { return pages.rawDirectory(); }
+
+  // Calls func(page_address, bytes) for every page that was written to, in ascending address order
+  template <typename F> void forEachPage(F func) const {
+    pages.forEach([&](uint32_t address, const Page& page) { func(address, page.bytes); });
+  }
+
+  // Pages loaded from a snapshot or an executable are used in place, data holds count pages and is owned by the caller
+  // Mapped pages can start anywhere inside data
+  void borrowPages(uint8_t* data, uint32_t count) { pages.borrow((const Page*)data, count); }
+  void mapPage(uint32_t address, uint8_t* bytes) { pages.map(address, (Page*)bytes); }
+  bool hasPage(uint32_t address) const { return pages.find(address) != nullptr; }
+
+  // Copies size bytes to memory, one page at a time
+  void writeBytes(uint32_t address, const uint8_t* data, uint32_t size) {
+    while ( size ) {
+      uint32_t chunk = std::min(size, PAGE_SIZE - (address & PAGE_MASK));
+      memcpy(pageForWrite(address) + (address & PAGE_MASK), data, chunk);
+      address += chunk;
+      data += chunk;
+      size -= chunk;
+    }
+  }
+
+  // Copies size bytes from memory, one page at a time
+  void readBytes(uint32_t address, uint8_t* data, uint32_t size) const {
+    while ( size ) {
+      uint32_t chunk = std::min(size, PAGE_SIZE - (address & PAGE_MASK));
+      memcpy(data, pageForRead(address) + (address & PAGE_MASK), chunk);
+      address += chunk;
+      data += chunk;
+      size -= chunk;
+    }
+  }
+
+  // Copies size bytes the way memmove would, ranges can overlap
+  void moveBytes(uint32_t dst, uint32_t src, uint32_t size) {
+    if ( dst <= src ) {
+      while ( size ) {
+        uint32_t chunk = std::min({ size, PAGE_SIZE - (dst & PAGE_MASK), PAGE_SIZE - (src & PAGE_MASK) });
+        uint8_t* to = pageForWrite(dst) + (dst & PAGE_MASK);
+        memmove(to, pageForRead(src) + (src & PAGE_MASK), chunk);
+        dst += chunk;
+        src += chunk;
+        size -= chunk;
+      }
+      return;
+    }
+    // Higher destination is copied from the end, so bytes are read before they are overwritten
+    dst += size;
+    src += size;
+    while ( size ) {
+      uint32_t chunk = std::min({ size, ((dst - 1) & PAGE_MASK) + 1, ((src - 1) & PAGE_MASK) + 1 });
+      dst -= chunk;
+      src -= chunk;
+      size -= chunk;
+      uint8_t* to = pageForWrite(dst) + (dst & PAGE_MASK);
+      memmove(to, pageForRead(src) + (src & PAGE_MASK), chunk);
+    }
+  }
+
+  // Writes count copies of the word from address on, address doesn't have to be aligned
+  void fillWords(uint32_t address, uint32_t word, uint32_t count) {
+    uint64_t size = (uint64_t)count * 4;
+    while ( size ) {
+      uint32_t chunk = std::min(size, (uint64_t)PAGE_SIZE - (address & PAGE_MASK));
+      uint8_t* bytes = pageForWrite(address) + (address & PAGE_MASK);
+      if ( word == (word & 0xff) * 0x01010101u ) {
+        memset(bytes, word & 0xff, chunk);
+      } else {
+        // Chunk can start in the middle of a word if the previous one ended at an unaligned page boundary
+        uint32_t shift = ((uint64_t)count * 4 - size) % 4 * 8;
+        uint32_t rotated = shift ? (word >> shift) | (word << (32 - shift)) : word;
+        uint32_t i = 0;
+        for ( ; i + 4 <= chunk; i += 4 ) memcpy(bytes + i, &rotated, 4);
+        for ( ; i < chunk; i++ ) bytes[i] = rotated >> (i % 4 * 8);
+      }
+      address += chunk;
+      size -= chunk;
+    }
+  }
+
+  // Offset of the first byte that differs between the two ranges, or size if they are equal
+  uint32_t firstDifference(uint32_t first, uint32_t second, uint32_t size) const {
+    uint32_t offset = 0;
+    while ( offset < size ) {
+      uint32_t a = first + offset, b = second + offset;
+      uint32_t chunk = std::min({ size - offset, PAGE_SIZE - (a & PAGE_MASK), PAGE_SIZE - (b & PAGE_MASK) });
+      const uint8_t* x = pageForRead(a) + (a & PAGE_MASK);
+      const uint8_t* y = pageForRead(b) + (b & PAGE_MASK);
+      if ( memcmp(x, y, chunk) != 0 ) {
+        for ( uint32_t i = 0; ; i++ ) if ( x[i] != y[i] ) return offset + i;
+      }
+      offset += chunk;
+    }
+    return size;
+  }
+
+  // Tracking has to be enabled before generated code is set up, since it marks pages inline
+  void trackDirtyPages();
+  uint8_t* getDirtyMap() const { return dirty_map; }
+  // Saves all pages and starts tracking from a clean state
+  void checkpoint();
+
+  // Puts every page written since the checkpoint back to its saved contents, pages allocated after the checkpoint
+  // are zeroed. Calls func(page_address) for each of them
+  template <typename F> void restoreDirty(F func) {
+    pages.forEach([&](uint32_t address, Page& page) {
+      uint8_t& dirty = dirty_map[address >> PAGE_BITS];
+      if ( !dirty ) return;
+      dirty = 0;
+      const Page* saved = checkpoint_pages.find(address);
+      memcpy(page.bytes, saved ? saved->bytes : zero_page.bytes, PAGE_SIZE);
+      func(address);
+    });
+  }
+
   uint32_t readMMReg(uint8_t index) const {
     return readWord(MM_REGS_BASE + index * 4);
   }
@@ -73,15 +236,19 @@ struct CPU {
   uint32_t gpr[GPR_CNT] = {};
   uint32_t csr[CSR_CNT] = {};
 
-  // Interrupt request flags
+  // Interrupt requests, bit (1 << cause) is set while request for that cause is pending
   // 0 - invalid instruction; 1 - timer; 2 - terminal; 3 - software interrupt; 
   // priority: 0 == 3 >> 2 >> 1
-  bool IR[4] = {};
+  // Devices running on other threads set their bits with release stores, CPU checks the whole mask with one
+  // relaxed load and works out priority and masking only when something is pending
+  std::atomic<uint32_t> pending{0};
   // Value of status registers I bit before entering interrupt handling routine in which I has to be cleared(interrupts masked)
   bool lastI = 0;
 
-  void setInterruptRequest(uint8_t cause) { IR[cause] = true; }
-  void clearInterruptRequest(uint8_t cause) { IR[cause] = false; }
+  void setInterruptRequest(uint8_t cause) { pending.fetch_or(1u << cause, std::memory_order_release); }
+  void clearInterruptRequest(uint8_t cause) { pending.fetch_and(~(1u << cause), std::memory_order_relaxed); }
+  bool hasInterruptRequests() const { return pending.load(std::memory_order_relaxed) != 0; }
+  bool hasInterruptRequest(uint8_t cause) const { return pending.load(std::memory_order_relaxed) & (1u << cause); }
   void maskInterrupts() { lastI = csr[STATUS] & FLAG_I; csr[STATUS] |= FLAG_I; }
   void unmaskInterrupts() { if ( !lastI ) csr[STATUS] &= ~FLAG_I; }
   void setIF() { csr[STATUS] |= FLAG_I; }
@@ -91,6 +258,22 @@ struct CPU {
   bool getTrF() const { return csr[STATUS] & FLAG_TR; }
   bool getTlF() const { return csr[STATUS] & FLAG_TL; }
 
+  // Cause of the request that would be accepted after the current instruction, or -1 if there is none
+  int acceptedInterrupt() const {
+    uint32_t requests = pending.load(std::memory_order_relaxed);
+    if ( !requests ) return -1;
+    // Pairs with the release in setInterruptRequest, so whatever device wrote before the request is visible
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ( requests & (1u << INT) ) return INT;
+    if ( requests & (1u << INV) ) return INV;
+    if ( getIF() ) return -1;
+    if ( (requests & (1u << TERM)) && !getTlF() ) return TERM;
+    if ( (requests & (1u << TIM)) && !getTrF() ) return TIM;
+    return -1;
+  }
+
+  bool interruptPending() const { return acceptedInterrupt() >= 0; }
+
 };
 
 
@@ -0,0 +1,147 @@
+#ifndef DECODECACHE_H
+#define DECODECACHE_H
+
+#include <stdint.h>
+#include "PageTable.hpp"
+#include "ComputerSystem.hpp"
+
+// Handlers that instructions are decoded to, one for every valid OC/MOD combination
+enum Op : uint8_t {
+  OP_NONE,          // Entry hasn't been decoded yet
+  OP_HALT,          // 0x00
+  OP_INT,           // 0x10
+  OP_WFI,           // 0x11
+  OP_CALL,          // 0x20
+  OP_CALL_MEM,      // 0x21
+  OP_JMP,           // 0x30
+  OP_BEQ,           // 0x31
+  OP_BNE,           // 0x32
+  OP_BGT,           // 0x33
+  OP_JMP_MEM,       // 0x38
+  OP_BEQ_MEM,       // 0x39
+  OP_BNE_MEM,       // 0x3a
+  OP_BGT_MEM,       // 0x3b
+  OP_XCHG,          // 0x40
+  OP_ADD,           // 0x50
+  OP_SUB,           // 0x51
+  OP_MUL,           // 0x52
+  OP_DIV,           // 0x53
+  OP_NOT,           // 0x60
+  OP_AND,           // 0x61
+  OP_OR,            // 0x62
+  OP_XOR,           // 0x63
+  OP_SHL,           // 0x70
+  OP_SHR,           // 0x71
+  OP_ST,            // 0x80
+  OP_ST_PUSH,       // 0x81
+  OP_ST_MEM,        // 0x82
+  OP_CSRRD,         // 0x90
+  OP_LD_REG,        // 0x91
+  OP_LD_MEM,        // 0x92
+  OP_LD_POP,        // 0x93
+  OP_CSRWR,         // 0x94
+  OP_CSR_OR,        // 0x95
+  OP_CSR_LD_MEM,    // 0x96
+  OP_CSR_POP,       // 0x97
+  OP_INVALID,       // Any other OC/MOD
+  OP_BLOCK_END,     // Marks the end of a translated block, never produced by decoding
+  // Instruction fused with the one after it, fields are the first one's unless noted
+  OP_IRET,          // pop pc + pop status, one instruction that has to execute atomically
+  OP_PUSH_PAIR,     // Two pushes, reg_B is the register pushed second
+  OP_POP_PAIR,      // Two pops, reg_C is the register popped second
+  OP_LD_INDIRECT,   // Load of an address from the literal pool, and load from that address into the same register
+  OP_COUNT
+};
+
+// Instruction with all of its fields already extracted
+struct DecodedInstr {
+  uint32_t instr;
+  uint32_t disp;    // Sign extended
+  uint8_t op;
+  uint8_t reg_A;
+  uint8_t reg_B;
+  uint8_t reg_C;
+};
+
+// Cache of decoded instructions keyed by guest PC
+// Only word aligned addresses are cached, instructions at unaligned addresses are decoded on every fetch
+// Decoding looks at the word after the instruction as well, IRET is always fused. Pairs of instructions are fused
+// only if the engine asked for them, its handlers run both in one dispatch and account for two instructions
+class DecodeCache {
+
+  struct DecodedPage {
+    DecodedInstr entries[PAGE_SIZE / 4] = {};
+  };
+
+  PageTable<DecodedPage> pages;
+  DecodedInstr unaligned = {};
+  bool fuse_pairs = false;
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+
+  static uint32_t entryIndex(uint32_t address) { return (address & PAGE_MASK) >> 2; }
+
+  void invalidateEntry(uint32_t address) {
+    DecodedPage* page = pages.find(address);
+    if ( page ) page->entries[entryIndex(address)].op = OP_NONE;
+  }
+
+public:
+
+  static uint8_t decodeOp(uint8_t oc_mod);
+  static void decode(uint32_t instr, DecodedInstr& decoded);
+  // Fuses the decoded instruction at pc with the word that follows it, if they make up one of the fused ops
+  static void fuse(const Memory& memory, uint32_t pc, DecodedInstr& decoded, bool pairs);
+
+  // Entries already decoded are dropped when this changes
+  void setFusePairs(bool fuse) {
+    if ( fuse != fuse_pairs ) clear();
+    fuse_pairs = fuse;
+  }
+
+  const DecodedInstr& fetch(const Memory& memory, uint32_t pc) {
+    if ( pc & 3 ) {
+      misses++;
+      decode(memory.readWord(pc), unaligned);
+      fuse(memory, pc, unaligned, false);
+      return unaligned;
+    }
+
+    DecodedPage* page = pages.find(pc);
+    if ( !page ) page = pages.allocate(pc);
+
+    DecodedInstr& entry = page->entries[entryIndex(pc)];
+    if ( entry.op != OP_NONE ) {
+      hits++;
+    } else {
+      misses++;
+      decode(memory.readWord(pc), entry);
+      fuse(memory, pc, entry, fuse_pairs);
+    }
+    return entry;
+  }
+
+  // Must be called after every guest write to memory, drops entries for instructions that overlap the written word,
+  // and the one before them which could have been fused with it
+  void invalidate(uint32_t address) {
+    invalidateEntry((address & ~3u) - 4);
+    invalidateEntry(address & ~3u);
+    if ( address & 3 ) invalidateEntry((address & ~3u) + 4);
+  }
+
+  // Drops every entry on the page that contains the address, and the last one before it
+  void invalidatePage(uint32_t address) {
+    DecodedPage* page = pages.find(address);
+    if ( page ) *page = DecodedPage();
+    invalidateEntry((address & ~PAGE_MASK) - 4);
+  }
+
+  void clear() { pages.clear(); }
+
+  uint64_t getHits() const { return hits; }
+  uint64_t getMisses() const { return misses; }
+
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef DEVICEBUS_H
+#define DEVICEBUS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ComputerSystem.hpp"
+
+// Devices are mapped in the memory mapped register window at the top of the address space, so memory accesses
+// need a single comparison to tell that they don't reach any device
+#define DEVICE_BASE     MM_REGS_BASE
+#define DEVICE_SLOTS    ((uint32_t)(0 - DEVICE_BASE) / 4)
+
+// Callbacks get the context device was attached with, and the offset of the register inside the device's range
+typedef uint32_t (*DeviceRead)(void* context, uint32_t offset);
+typedef void (*DeviceWrite)(void* context, uint32_t offset, uint32_t word);
+
+/*
+  Memory mapped device
+  Register values live in guest memory, so snapshots, fuzzing resets and JIT lockstep treat them as any other word
+  Write callback runs after the word was stored, read callback replaces the stored value, either can be left out
+*/
+struct Device {
+  std::string name;
+  uint32_t base;
+  uint32_t size;          // In bytes, base and size are multiples of 4
+  void* context;
+  DeviceRead read;
+  DeviceWrite write;
+};
+
+/*
+  Device bus
+  Every register slot in the window holds the index of the device that claimed it, so finding the device is a
+  single table lookup. Accesses to slots no device claimed are plain memory accesses
+*/
+class DeviceBus {
+
+  std::vector<Device> devices;
+  int8_t slots[DEVICE_SLOTS];
+
+public:
+
+  DeviceBus();
+
+  // Returns false if the range isn't inside the window, or overlaps a device already attached
+  bool attach(const Device& device);
+
+  // Address has to be inside the window
+  const Device* find(uint32_t address) const {
+    int8_t slot = slots[(address - DEVICE_BASE) >> 2];
+    return slot >= 0 ? &devices[slot] : nullptr;
+  }
+
+  const std::vector<Device>& getDevices() const { return devices; }
+
+};
+
+#endif
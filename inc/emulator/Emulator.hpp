@@ -7,11 +7,27 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <cerrno>
+#include <csignal>
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "../elf/Elf32File.hpp"
 #include "ComputerSystem.hpp"
+#include "DecodeCache.hpp"
+#include "BlockCache.hpp"
+#include "JitCompiler.hpp"
+#include "AotRuntime.hpp"
+#include "Terminal.hpp"
+#include "Snapshot.hpp"
+#include "ProgramImage.hpp"
+#include "Profiler.hpp"
+#include "CallGraph.hpp"
+#include "Trace.hpp"
+#include "PerfCounters.hpp"
+#include "DeviceBus.hpp"
+#include "HostCalls.hpp"
 
 // OC | MOD | REGA | REGB | REGC | DISP | DISP | DISP
 
@@ -28,6 +44,27 @@
 #define REG_B_OFFSET      16
 #define REG_C_OFFSET      12
 
+// Number of instructions the threaded and block engines execute between two polls of the terminal input
+#define TERMINAL_POLL_INTERVAL  1024
+
+// Default number of guest instructions per millisecond of virtual time
+#define VIRTUAL_TIMER_RATE      1000
+#define NO_DEADLINE             UINT64_MAX
+
+// Default number of instructions a single fuzzing run can take before it is stopped
+#define FUZZ_LIMIT              10000000
+
+// Default time between two samples of the sampling profiler, in microseconds
+#define SAMPLE_INTERVAL_US      1000
+
+// Dispatch engines that runCPU can use
+enum Engine {
+  ENGINE_SWITCH,      // One switch over decoded instruction per iteration, devices and interrupts checked after every instruction
+  ENGINE_THREADED,    // Handlers jump directly to the next one (computed goto), the loop is left only for pending interrupts
+  ENGINE_BLOCK,       // Translated basic blocks chained to their successors, interrupts are checked at block boundaries
+  ENGINE_JIT          // Block engine which compiles hot blocks into native code
+};
+
 
 class Emulator {
 
@@ -35,53 +72,317 @@ class Emulator {
 
   Memory memory;
   CPU cpu;
-  static bool cpu_on;
+  DecodeCache decode_cache;
+  BlockCache block_cache;
+  JitCompiler jit;
+  // Set when a guest store hits a page with translated blocks, or when translations have to be dropped for other reasons
+  bool code_written = false;
+  Engine engine = ENGINE_SWITCH;
+
+  // JIT lockstep mode, every compiled block is first interpreted and then replayed natively from the same state
+  bool jit_lockstep = false;
+  Block* lockstep_block = nullptr;
+  uint32_t lockstep_gpr[GPR_CNT] = {};
+  uint32_t lockstep_csr[CSR_CNT] = {};
+  bool journaling = false;
+  bool replaying = false;
+  // Address and previous value of every word stored while journaling
+  std::vector<std::pair<uint32_t, uint32_t>> store_journal;
+
+  // Set by the first run, terminal and JIT are set up only once
+  bool started = false;
+  bool halted = false;
+  // Why the last load, save or first run failed, command line tool prints it and exits
+  std::string error = "";
+
+  Terminal terminal;
+  // Headless mode, terminal input comes from a script and one character is injected at most every input_interval
+  // retired instructions(or milliseconds of virtual time)
+  bool headless = false;
+  std::string input_file = "";
+  std::string output_file = "";
+  uint64_t input_interval = 0;
+  bool input_interval_ms = false;
+  uint64_t next_input = 0;
+  // Set when a terminal interrupt is accepted, next character waits until its handler unmasks interrupts again
+  bool terminal_handling = false;
+
+  // Executable segments are mapped into memory straight from the file
+  ProgramImage image;
 
-  // Terminal
-  termios old_attr;
-  int old_flags;
-  bool out_flag = false;
-  
+  // Snapshot is saved when processor halts, and execution resumes after the halt when it is loaded
+  std::string save_snapshot = "";
+  std::string load_snapshot = "";
+  Snapshot snapshot;
+
+  // Fork server style fuzzing, after the first halt every file from fuzz_dir is run as terminal input from that
+  // point, and only pages dirtied by the run are restored before the next one
+  std::string fuzz_dir = "";
+  uint64_t fuzz_limit = FUZZ_LIMIT;
+  uint64_t fuzz_runs = 0;
+  uint64_t fuzz_limits = 0;
+  uint64_t fuzz_invalid = 0;
+  // Engines return once this many instructions have retired
+  uint64_t run_limit = NO_DEADLINE;
+  uint64_t invalid_instructions = 0;
+
+  // Exact profile, switch and threaded engines count every instruction they execute and the report is written at halt
+  bool profiling = false;
+  std::string profile_file = "";
+  Profiler profiler;
+
+  // Call graph profile, written in callgrind format at halt
+  bool call_graph = false;
+  std::string call_graph_file = "";
+  CallGraph calls;
+  // Instruction trace, records are written out by the trace writer's thread while the guest runs
+  bool tracing = false;
+  std::string trace_file = "";
+  TraceWriter trace;
+  // Set if any of the exact profilers or the trace has to see every instruction
+  bool instrumented = false;
+
+  // Sampling profile, sampler thread asks for a sample every sample_interval microseconds of host time and engines
+  // take it at their next poll point, on the emulation thread, so guest state is never read while it changes
+  bool sampling = false;
+  std::string sample_file = "";
+  uint32_t sample_interval = SAMPLE_INTERVAL_US;
+  std::atomic<bool> sample_requested{false};
+  std::thread* sampler_thread = nullptr;
+  bool sampler_running = false;
+  std::mutex sampler_mutex;
+  std::condition_variable sampler_cv;
+
+  // Performance counters, printed at halt, written as JSON to stats_file, and to stderr when SIGUSR1 arrives
+  PerfCounters counters;
+  std::string stats_file = "";
+  double host_seconds = 0;
+  std::chrono::steady_clock::time_point run_start;
+  bool in_run = false;
+  // Signal handler counts requests, every instance writes its counters at its next poll point if it hasn't seen them
+  static std::atomic<uint32_t> stats_requests;
+  uint32_t stats_seen = 0;
+  static void requestStats(int signal);
+
+  // Terminal and timer registers, and whatever devices library users attach
+  DeviceBus devices;
 
   static uint32_t timer_periods[];
+  // Timer configuration register, kept here so the timer thread doesn't read guest memory
+  std::atomic<uint32_t> timer_config{0};
   std::thread* timer_thread = nullptr;
+  bool timer_started = false;
+  // Timer thread runs until the emulator stops it, condition variable lets it stop in the middle of a period
+  bool timer_running = false;
+  std::mutex timer_mutex;
+  std::condition_variable timer_cv;
+
+  // Virtual time, timer interrupt is raised when the number of retired instructions reaches the deadline
+  // Engines account for instructions in batches, so the count is exact only at poll points and block ends
+  bool virtual_timer = false;
+  uint32_t timer_rate = VIRTUAL_TIMER_RATE;
+  uint64_t retired = 0;
+  uint64_t timer_deadline = NO_DEADLINE;
+  uint64_t timer_ticks = 0;
+
+  // Idle loop detection, engines arm it at poll points and call checkIdle with the target of every taken jump
+  // Guest which jumps to the same address twice with the same registers, and nothing was stored or delivered by a
+  // device in between, will keep looping until an interrupt, so emulator skips ahead or sleeps until the next event
+  enum { IDLE_OFF, IDLE_ARMED, IDLE_WATCHING };
+  bool idle_skip = true;
+  int idle_state = IDLE_OFF;
+  uint32_t idle_pc = 0;
+  uint32_t idle_gpr[GPR_CNT] = {};
+  uint32_t idle_csr[CSR_CNT] = {};
+  uint64_t idle_changes = 0;
+  // Incremented by every store, device read, interrupt entry and terminal input
+  uint64_t state_changes = 0;
+  uint64_t idle_waits = 0;
+  uint64_t skipped = 0;
+  // Number of wfi instructions which had to wait
+  uint64_t wfi_waits = 0;
+  std::mutex idle_mutex;
+  std::condition_variable idle_cv;
+
+  // Block engines run recognized copy, fill and compare loops as host memory operations
+  bool loop_idioms = true;
+  uint64_t idiom_runs = 0;
+  uint64_t idiom_iterations = 0;
 
-  void loadMemory();
-  void runCPU();
+  // Number of calls guest made through the host call registers
+  uint64_t host_calls = 0;
+  // Host files guest can read, empty if it can't read any
+  std::string host_dir = "";
+
+  bool loadMemory();
+  bool loadSnapshot();
+  bool saveSnapshot();
+  bool fail(std::string message) { error = message; return false; };
+  void exitWithError();
+  void captureState(SnapshotHeader& state);
+  void restoreState(const SnapshotHeader& state);
+  void runEngine();
+  void runFuzz();
+  void resetToCheckpoint(const SnapshotHeader& checkpoint);
+  void runSwitch();
+  void runThreaded();
+  void runBlocks();
+  void setUpJit();
+  void startLockstep(Block* block);
+  void finishLockstep();
   void printCPUState();
-  void setUpTerminal();
+  bool setUpTerminal();
   void restoreTerminal();
   void startTimer();
-  static void timerBody(Memory& memory, CPU& cpu);
-  static bool getCpuOn() { return cpu_on; };
+  void stopTimer();
+  uint64_t timerPeriod();
+  void timerExpired();
+  void checkIdle(uint32_t target);
+  uint32_t runIdiom(const LoopIdiom& idiom);
+  void waitForEvent();
+  void waitForInterrupt();
+  bool skipToEvent(bool masked);
+  bool terminalReady() const;
+  void wakeUp() { idle_cv.notify_one(); }
+  void armIdle() { if ( idle_skip ) idle_state = IDLE_ARMED; }
+
+  void advanceTime(uint32_t executed) {
+    retired += executed;
+    if ( retired >= timer_deadline ) timerExpired();
+  }
+
+  // Number of instructions engines can run before they have to advance time and poll the terminal, 0 once the run
+  // is over
+  uint32_t pollBudget() const {
+    uint64_t left = std::min(timer_deadline, run_limit) - retired;
+    if ( left >= TERMINAL_POLL_INTERVAL ) return TERMINAL_POLL_INTERVAL;
+    return left;
+  }
+  void timerBody();
 
-  uint32_t fetchInstruction() { 
-    uint32_t instr =  memory.readWord(cpu.gpr[PC]);
+  void startSampler();
+  void stopSampler();
+  void samplerBody();
+  void takeSample();
+  // Switch and threaded engines call this before every instruction when instrumented, pc is its address
+  void instrument(uint32_t pc, const DecodedInstr& decoded) {
+    if ( profiling ) profiler.count(pc);
+    if ( call_graph ) calls.step(pc, decoded.op, decoded.reg_A);
+    if ( tracing ) trace.step(pc, decoded.instr, cpu.gpr);
+  }
+
+  // Engines call this where they poll for terminal input
+  void pollRequests() {
+    if ( sample_requested.load(std::memory_order_relaxed) ) takeSample();
+    if ( stats_requests.load(std::memory_order_relaxed) != stats_seen ) dumpCounters();
+  }
+  void dumpCounters();
+
+  const DecodedInstr& fetchInstruction() { 
+    const DecodedInstr& decoded = decode_cache.fetch(memory, cpu.gpr[PC]);
     cpu.gpr[PC] += 4;
-    return instr;
+    return decoded;
   };
 
+  // Every guest write to memory has to go through here, so stale decoded instructions are dropped
+  void storeWord(uint32_t address, uint32_t word);
+  // Guest loads, only addresses in the device window go to the bus
+  uint32_t loadWord(uint32_t address) {
+    if ( address >= DEVICE_BASE ) return deviceRead(address);
+    return memory.readWord(address);
+  }
+  uint32_t deviceRead(uint32_t address);
+  void deviceWrite(uint32_t address, uint32_t word);
+  static void terminalWrite(void* context, uint32_t offset, uint32_t word);
+  static void timerWrite(void* context, uint32_t offset, uint32_t word);
+  static void hostWrite(void* context, uint32_t offset, uint32_t word);
+  uint32_t hostCall(uint32_t call);
+  void rangeWritten(uint32_t address, uint32_t size);
   void pushWord(uint32_t val);
   uint32_t popWord();
 
   void handleInterrupt(uint8_t cause);
+  void checkInterrupts();
   void handleTerminal();
 
-protected:
-
-  Emulator() {};
-
-  static Emulator* emulator;
-
 public:
 
+  Emulator();
   Emulator(Emulator&) = delete;
   void operator=(const Emulator&) = delete;
-  static Emulator* getInstance();
+  ~Emulator() { stopTimer(); stopSampler(); }
 
   void setFileName(std::string name) { file_name = name; };
+  void setEngine(Engine engine) { this->engine = engine; };
+  void setJitLockstep(bool lockstep) { jit_lockstep = lockstep; };
+  void setVirtualTimer(bool virtual_timer) { this->virtual_timer = virtual_timer; };
+  void setTimerRate(uint32_t rate) { timer_rate = rate; };
+  void setIdleSkip(bool skip) { idle_skip = skip; };
+  void setLoopIdioms(bool enabled) { loop_idioms = enabled; };
+  void setHostDir(std::string dir) { host_dir = dir; };
+  void setHeadless(bool headless) { this->headless = headless; };
+  void setInputFile(std::string name) { input_file = name; headless = true; };
+  void setOutputFile(std::string name) { output_file = name; headless = true; };
+  void setInputInterval(uint64_t interval, bool in_ms) { input_interval = interval; input_interval_ms = in_ms; };
+  void setSaveSnapshot(std::string name) { save_snapshot = name; };
+  void setLoadSnapshot(std::string name) { load_snapshot = name; };
+  void setFuzzDir(std::string name) { fuzz_dir = name; headless = true; };
+  void setFuzzLimit(uint64_t limit) { fuzz_limit = limit; };
+  void setProfileFile(std::string name) { profile_file = name; profiling = instrumented = true; };
+  void setCallGraphFile(std::string name) { call_graph_file = name; call_graph = instrumented = true; };
+  void setTraceFile(std::string name) { trace_file = name; tracing = instrumented = true; };
+  void setSampleFile(std::string name) { sample_file = name; sampling = true; };
+  void setSampleInterval(uint32_t interval) { sample_interval = interval; };
+  void setStatsFile(std::string name) { stats_file = name; };
+  // Lets SIGUSR1 ask running instances for their counters
+  static void installStatsSignal();
+  // Takes engine, timer, idle and terminal settings from another instance, not its files or machine state
+  void copySettings(const Emulator& other);
+  // Command line tool, runs the machine to halt and prints its state
   void startEmulating();
 
+  /*
+    Library interface
+    Every instance is a separate machine with its own memory, caches, terminal and timer thread, so instances can
+    run on different threads at the same time. Only translated blocks from AotRuntime are shared(read only)
+    Terminal of an instance that should run next to others has to be headless
+  */
+  // Loads an executable, or machine state saved with saveSnapshot. Snapshot pages are mapped copy on write, so
+  // instances loaded from the same snapshot share every page none of them has written to
+  // Return false if the file couldn't be loaded or written, getError tells why
+  bool loadExecutable(std::string name) { file_name = name; return loadMemory(); };
+  bool loadSnapshot(std::string name) { load_snapshot = name; return loadSnapshot(); };
+  bool saveSnapshot(std::string name) { save_snapshot = name; return saveSnapshot(); };
+  const std::string& getError() const { return error; };
+
+  // Maps a device into the register window, returns false if its range is taken or outside the window
+  // Its callbacks run on the thread running the instance
+  bool attachDevice(const Device& device) { return devices.attach(device); };
+
+  // Terminal device, input is delivered to the guest as scripted terminal input, captured output is kept in memory
+  void setInput(const std::string& input) { headless = true; terminal.setInput(input); };
+  void captureOutput() { headless = true; terminal.startCapture(); };
+  const std::string& getOutput() const { return terminal.getCaptured(); };
+
+  // Runs until the processor halts or the given number of instructions retires, returns true if it halted
+  // Next call continues where this one stopped, after a halt that is the instruction following halt
+  // First run opens terminal input and output files, if it can't it returns false right away with getError set
+  bool run(uint64_t instructions = NO_DEADLINE);
+  bool isHalted() const { return halted; };
+  uint64_t getRetired() const { return retired; };
+  // Counters so far, block and JIT engines count instructions per block, so their mix includes the current block
+  PerfCounters getCounters() const;
+
+  uint32_t getRegister(uint8_t index) const { return cpu.gpr[index]; };
+  uint32_t getCsr(uint8_t index) const { return cpu.csr[index]; };
+  void setRegister(uint8_t index, uint32_t value) { cpu.gpr[index] = value; };
+  uint32_t readMemory(uint32_t address) const { return memory.readWord(address); };
+  void writeMemory(uint32_t address, uint32_t word) { storeWord(address, word); };
+
+  // Slow paths of guest memory access for native code, context is the emulator
+  static uint32_t jitReadWord(void* context, uint32_t address);
+  static uint32_t jitWriteWord(void* context, uint32_t address, uint32_t word);
+
   static uint32_t extractDisplacement(uint32_t instr) {
     uint32_t disp = instr & DISP_MASK;
     if ( disp & DISP_SIGN_MASK ) disp |= DISP_EXTEND_MASK;
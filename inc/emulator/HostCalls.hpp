@@ -0,0 +1,30 @@
+#ifndef HOSTCALLS_H
+#define HOSTCALLS_H
+
+#include "ComputerSystem.hpp"
+
+/*
+  Host call registers
+  Guest writes the arguments and then the call number to HOST_CALL, call is done by the time that store completes
+  and its result is in HOST_RESULT. Argument and result registers are plain memory words, so they can be read back
+  Ranges of guest memory a call reads or writes can't wrap around or reach the memory mapped register window
+*/
+#define HOST_REGS_BASE    (MM_REGS_BASE + 0x80)
+// Longest path HOST_READ_FILE accepts, with the terminating zero
+#define HOST_PATH_MAX     4096
+#define HOST_ERROR        0xffffffff
+
+enum {
+  HOST_CALL, HOST_ARG0, HOST_ARG1, HOST_ARG2, HOST_RESULT, HOST_REGS_CNT
+};
+
+enum {
+  HOST_COPY = 1,        // Copies ARG2 bytes from ARG1 to ARG0 as memmove would, result is 0
+  HOST_FILL,            // Stores ARG2 copies of the word ARG1 from ARG0 on, result is 0
+  HOST_WRITE,           // Writes ARG1 bytes from ARG0 to the terminal, result is the number of bytes
+  HOST_READ_FILE        // Reads at most ARG2 bytes of the host file named by the string at ARG0 to ARG1, result is
+                        // the number of bytes read. Name is relative to the directory given with -host-dir, without
+                        // it(and while fuzzing) the call always fails
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef JITCOMPILER_H
+#define JITCOMPILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ComputerSystem.hpp"
+#include "BlockCache.hpp"
+
+// Number of times a block has to be entered before it is compiled
+#define JIT_HOT_THRESHOLD   50
+// Size of executable buffer, when it fills up all translations are dropped
+#define JIT_CODE_SIZE       (16 * 1024 * 1024)
+
+// Values returned from compiled blocks, guest PC is always set before returning
+// Block which stopped after a store that hit translated code returns the number of its instructions that retired
+// instead, which is never JIT_EXIT_NEXT
+enum {
+  JIT_EXIT_NEXT       // Block finished normally
+};
+
+// Slow paths of guest memory access called from generated code
+// Write helper returns non zero if the store hit translated code
+typedef uint32_t (*JitReadHelper)(void* context, uint32_t address);
+typedef uint32_t (*JitWriteHelper)(void* context, uint32_t address, uint32_t word);
+
+// Compiles translated blocks into native x86-64 code
+// Guest registers used in a block are kept in host registers for the whole block, memory accesses to allocated
+// pages which aren't code or MMIO are done inline, and everything else goes through the helpers
+class JitCompiler {
+
+  uint8_t* code = nullptr;
+  size_t used = 0;
+  bool full = false;
+
+  const void* page_directory = nullptr;
+  const uint8_t* code_map = nullptr;
+  // Set if memory tracks dirty pages, it has to be enabled before init
+  uint8_t* dirty_map = nullptr;
+  JitReadHelper read_helper = nullptr;
+  JitWriteHelper write_helper = nullptr;
+
+  uint64_t compiled = 0;
+  uint64_t rejected = 0;
+
+public:
+
+  JitCompiler() {};
+  JitCompiler(JitCompiler&) = delete;
+  void operator=(const JitCompiler&) = delete;
+  ~JitCompiler();
+
+  // Allocates the executable buffer, returns false if JIT isn't supported on this host
+  bool init(const Memory& memory, const BlockCache& block_cache, JitReadHelper read_helper, JitWriteHelper write_helper);
+  bool available() const { return code != nullptr; }
+
+  // Sets block.native on success, fails if block uses instructions or registers that aren't supported or buffer is full
+  bool compile(Block& block);
+
+  // Has to be called whenever blocks are flushed, since their native code is dropped as well
+  void reset() { used = 0; full = false; }
+  bool isFull() const { return full; }
+
+  uint64_t getCompiled() const { return compiled; }
+  uint64_t getRejected() const { return rejected; }
+
+};
+
+#endif
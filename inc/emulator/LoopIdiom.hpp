@@ -0,0 +1,82 @@
+#ifndef LOOPIDIOM_H
+#define LOOPIDIOM_H
+
+#include <stdint.h>
+#include "ComputerSystem.hpp"
+#include "DecodeCache.hpp"
+
+// Longest loop body that is looked at, copy and compare loops compiled from C need less than half of it
+#define IDIOM_MAX_INSTRUCTIONS  16
+// Iterations run at once at most, so a huge copy doesn't hold off polling for long
+#define IDIOM_MAX_ITERATIONS    (1u << 22)
+
+enum IdiomKind : uint8_t {
+  IDIOM_NONE,
+  IDIOM_COPY,       // Word loaded from one array and stored to another
+  IDIOM_FILL,       // Register that loop doesn't change stored to an array
+  IDIOM_COMPARE     // Words loaded from two arrays, loop is left through a branch as soon as they differ
+};
+
+// Word accessed by the loop, address is gpr[base] + gpr[index] + disp, registers as they were when it was accessed
+struct IdiomAccess {
+  uint8_t at;           // Position in the loop body
+  uint8_t base;
+  uint8_t index;
+  uint32_t disp;
+};
+
+/*
+  Copy, fill and compare loop
+  Body is a straight sequence of word loads and stores, additions of a constant or of an unchanged register
+  (induction registers), and a branch back to its start taken while two registers differ. Addresses move by one
+  word per iteration, in the same direction for all arrays. Register which is loaded is used only later in the same
+  iteration, by a store or the compare exit
+  Loop is run for many iterations at once over page memory, leaving registers, memory and PC as the instructions
+  would have left them
+*/
+struct LoopIdiom {
+  IdiomKind kind = IDIOM_NONE;
+  uint32_t start;
+  uint8_t size;                             // Instructions in the loop body, last one is the loop branch
+  DecodedInstr ops[IDIOM_MAX_INSTRUCTIONS];
+
+  // Induction registers, gpr[r] += step_reg >= 0 ? gpr[step_reg] * step_sign : step_const, at position updated
+  uint16_t induction = 0;                   // Bit for every induction register
+  int8_t step_reg[GPR_CNT];
+  int8_t step_sign[GPR_CNT];
+  uint32_t step_const[GPR_CNT];
+  uint8_t updated[GPR_CNT];
+
+  // Loads in body order, and the store for copy and fill(its source register is ops[store.at].reg_C)
+  uint8_t loads = 0;
+  IdiomAccess load[2];
+  IdiomAccess store;
+  uint8_t compare_exit = 0;                 // Position of the branch leaving a compare loop
+
+  // Returns nullptr if the code at start isn't a loop that can be run this way
+  static LoopIdiom* recognize(const Memory& memory, uint32_t start);
+
+  // Step of the register over one iteration for the current register values, 0 if loop doesn't change it
+  uint32_t step(const uint32_t* gpr, uint8_t reg) const {
+    if ( !(induction & (1u << reg)) ) return 0;
+    return step_reg[reg] >= 0 ? gpr[step_reg[reg]] * step_sign[reg] : step_const[reg];
+  }
+
+  // Value of the register when instruction at position is executed in the first iteration
+  uint32_t valueAt(const uint32_t* gpr, uint8_t reg, uint8_t at) const {
+    return updated[reg] < at ? gpr[reg] + step(gpr, reg) : gpr[reg];
+  }
+
+  // Address accessed in the first iteration, and the step between iterations
+  uint32_t address(const uint32_t* gpr, const IdiomAccess& access) const {
+    return valueAt(gpr, access.base, access.at) + valueAt(gpr, access.index, access.at) + access.disp;
+  }
+  uint32_t addressStep(const uint32_t* gpr, const IdiomAccess& access) const {
+    return step(gpr, access.base) + step(gpr, access.index);
+  }
+
+  // Number of iterations until the loop branch falls through, 0 if it never does
+  uint64_t iterations(const uint32_t* gpr) const;
+};
+
+#endif
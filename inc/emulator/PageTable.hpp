@@ -0,0 +1,111 @@
+#ifndef PAGETABLE_H
+#define PAGETABLE_H
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+
+// Guest address space is split into 4KiB pages, upper 20 bits of an address are split into
+// a 10 bit directory index and a 10 bit table index
+
+#define PAGE_BITS       12
+#define PAGE_SIZE       (1u << PAGE_BITS)
+#define PAGE_MASK       (PAGE_SIZE - 1)
+
+#define PT_DIR_BITS     10
+#define PT_TABLE_BITS   10
+#define PT_DIR_SIZE     (1u << PT_DIR_BITS)
+#define PT_TABLE_SIZE   (1u << PT_TABLE_BITS)
+
+// Two level table which maps guest pages to lazily allocated objects of type T
+template <typename T> class PageTable {
+
+  struct Level2 {
+    T* entries[PT_TABLE_SIZE] = {};
+  };
+
+  Level2* directory[PT_DIR_SIZE] = {};
+
+  // Entries inside these ranges were placed with map, they are owned by the caller and never deleted
+  std::vector<std::pair<const T*, const T*>> borrowed;
+
+  static uint32_t dirIndex(uint32_t address) { return address >> (PAGE_BITS + PT_TABLE_BITS); }
+  static uint32_t tableIndex(uint32_t address) { return (address >> PAGE_BITS) & (PT_TABLE_SIZE - 1); }
+
+public:
+
+  PageTable() {};
+  PageTable(PageTable&) = delete;
+  void operator=(const PageTable&) = delete;
+  ~PageTable() { clear(); }
+
+  // Returns the object for page that contains the address, or nullptr if it was never allocated
+  T* find(uint32_t address) const {
+    Level2* table = directory[dirIndex(address)];
+    return table ? table->entries[tableIndex(address)] : nullptr;
+  }
+
+  // Same as find, but allocates the page if it doesn't exist
+  T* get(uint32_t address) {
+    T* entry = find(address);
+    return entry ? entry : allocate(address);
+  }
+
+  T* allocate(uint32_t address) {
+    Level2*& table = directory[dirIndex(address)];
+    if ( !table ) table = new Level2();
+    T*& entry = table->entries[tableIndex(address)];
+    if ( !entry ) entry = new T();
+    return entry;
+  }
+
+  // Entries of an array owned by the caller(e.g. a mapped file) can be placed into the table with map
+  // Entries don't have to start at array elements, anything inside the array is treated as borrowed
+  void borrow(const T* array, uint32_t count) {
+    borrowed.push_back(std::make_pair(array, array + count));
+  }
+
+  void map(uint32_t address, T* entry) {
+    Level2*& table = directory[dirIndex(address)];
+    if ( !table ) table = new Level2();
+    T*& current = table->entries[tableIndex(address)];
+    if ( current && !isBorrowed(current) ) delete current;
+    current = entry;
+  }
+
+  bool isBorrowed(const T* entry) const {
+    for ( auto& range : borrowed ) {
+      if ( entry >= range.first && entry < range.second ) return true;
+    }
+    return false;
+  }
+
+  // Used by generated code to walk the table without calls
+  // Every directory entry is null or points to an array of PT_TABLE_SIZE entry pointers
+  const void* rawDirectory() const { return directory; }
+
+  void clear() {
+    for ( uint32_t i = 0; i < PT_DIR_SIZE; i++ ) {
+      if ( !directory[i] ) continue;
+      for ( uint32_t j = 0; j < PT_TABLE_SIZE; j++ ) {
+        if ( !isBorrowed(directory[i]->entries[j]) ) delete directory[i]->entries[j];
+      }
+      delete directory[i];
+      directory[i] = nullptr;
+    }
+  }
+
+  // Calls func(page_address, entry) for every allocated page, in ascending address order
+  template <typename F> void forEach(F func) const {
+    for ( uint32_t i = 0; i < PT_DIR_SIZE; i++ ) {
+      if ( !directory[i] ) continue;
+      for ( uint32_t j = 0; j < PT_TABLE_SIZE; j++ ) {
+        T* entry = directory[i]->entries[j];
+        if ( entry ) func((i << (PAGE_BITS + PT_TABLE_BITS)) | (j << PAGE_BITS), *entry);
+      }
+    }
+  }
+
+};
+
+#endif
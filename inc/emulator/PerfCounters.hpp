@@ -0,0 +1,37 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdint.h>
+#include <ostream>
+#include "DecodeCache.hpp"
+
+#define CAUSE_CNT 4
+
+/*
+  Performance counters
+  Every emulator instance keeps its own, and only the thread running it writes them, so they are plain integers
+  Memory reads and writes aren't counted one by one, every handler accesses a fixed number of words, so they are
+  worked out from the instruction mix and interrupt entries
+  Fused instructions are counted once, under their own names
+*/
+struct PerfCounters {
+  uint64_t ops[OP_COUNT] = {};
+  uint64_t mmio_reads = 0;
+  uint64_t mmio_writes = 0;
+  uint64_t interrupts[CAUSE_CNT] = {};
+
+  // Set when counters are reported
+  uint64_t retired = 0;
+  uint64_t skipped = 0;
+  double host_seconds = 0;
+
+  uint64_t executed() const { return retired - skipped; }
+  double mips() const { return host_seconds > 0 ? executed() / host_seconds / 1e6 : 0; }
+  uint64_t memoryReads() const;
+  uint64_t memoryWrites() const;
+
+  void print(std::ostream& os) const;
+  void writeJson(std::ostream& os) const;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "../elf/Elf32File.hpp"
+#include "PageTable.hpp"
+
+// Number of hottest addresses and symbols listed in the report
+#define PROFILE_TOP   32
+// Most return addresses kept for one sample, and how many stack words are searched for them
+#define SAMPLE_DEPTH  8
+#define SAMPLE_SCAN   64
+
+/*
+  Execution profiler
+  Exact mode: every retired instruction increments the counter of its address. Counters are flat arrays, one per
+  guest page and indexed by word offset inside the page, so counting is an array increment unless execution moved
+  to another page
+  Sampling mode: only occasional samples of the PC and the return addresses above it are recorded, and written out
+  as folded stacks(one "outer;...;inner count" line per distinct stack) for flame graph tools
+*/
+class Profiler {
+
+  struct PageCounts {
+    uint64_t counts[PAGE_SIZE / 4] = {};
+  };
+
+  PageTable<PageCounts> pages;
+  // Page that the last counted instruction was on, starts as an address no page can have
+  uint32_t current_page = 1;
+  uint64_t* current_counts = nullptr;
+
+  // Number of samples taken of each distinct stack, stack is the PC and then the return addresses, innermost first
+  // Long runs keep hitting the same stacks, so the table grows with the program and not with the run
+  std::map<std::vector<uint32_t>, uint64_t> stacks;
+  uint64_t sample_count = 0;
+
+  // Symbol addresses with their names, from the executable's symbol table
+  std::map<uint32_t, std::string> symbols;
+
+  void selectPage(uint32_t pc) {
+    current_page = pc & ~PAGE_MASK;
+    current_counts = pages.get(pc)->counts;
+  }
+
+  // Name of the symbol that contains the address, or "" if there is no symbol below it
+  std::string findSymbol(uint32_t address) const;
+  // Symbol name, or the address itself when there is no symbol
+  std::string frameName(uint32_t address) const;
+
+public:
+
+  Profiler() {};
+  Profiler(Profiler&) = delete;
+  void operator=(const Profiler&) = delete;
+
+  void count(uint32_t pc) {
+    if ( (pc & ~PAGE_MASK) != current_page ) selectPage(pc);
+    current_counts[(pc & PAGE_MASK) >> 2]++;
+  }
+
+  void addSample(uint32_t pc, const uint32_t* frames, uint32_t depth) {
+    std::vector<uint32_t> stack(depth + 1);
+    stack[0] = pc;
+    std::copy(frames, frames + depth, stack.begin() + 1);
+    stacks[stack]++;
+    sample_count++;
+  }
+  uint64_t getSampleCount() const { return sample_count; };
+
+  // Closest symbol at or below the address plus the offset from it, "?" if there is none
+  std::string symbolize(uint32_t address) const;
+  // Same, but the address itself is used when there is no symbol
+  std::string addressName(uint32_t address) const {
+    std::string name = symbolize(address);
+    return name != "?" ? name : frameName(address);
+  }
+
+  // Linker keeps only global and section symbols in executables, so local labels are reported as an offset from
+  // the closest of those
+  void loadSymbols(Elf32File& file);
+  // Returns false if the report file can't be written
+  bool writeReport(std::string file_name) const;
+  bool writeFolded(std::string file_name) const;
+
+};
+
+#endif
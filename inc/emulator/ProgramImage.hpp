@@ -0,0 +1,42 @@
+#ifndef PROGRAMIMAGE_H
+#define PROGRAMIMAGE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../elf/Elf32Mod.hpp"
+#include "ComputerSystem.hpp"
+
+/*
+  Executable image
+  Only the file header and program headers are read. File is mapped privately, and guest pages that a segment
+  covers completely point straight into the mapping, so loading costs the same for any image size and pages are
+  copied by the kernel only when guest writes to them. Partly covered pages at segment edges are copied
+*/
+class ProgramImage {
+
+  // Every executable loaded stays mapped, pages of an earlier one can still be in memory
+  std::vector<std::pair<uint8_t*, size_t>> mappings;
+
+  static void loadSegment(const uint8_t* data, const Elf32_Phdr& segment, Memory& memory);
+
+public:
+
+  ProgramImage() {};
+  ProgramImage(ProgramImage&) = delete;
+  void operator=(const ProgramImage&) = delete;
+  ~ProgramImage() { close(); }
+
+  // Returns false if the file can't be read, isn't an executable, or its segments are outside of it
+  // Mappings are kept until close, memory can't be used after that
+  bool load(std::string file_name, Memory& memory);
+  void close();
+
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ComputerSystem.hpp"
+
+#define SNAPSHOT_MAGIC    0x50414e53494d5341ull   // "ASMISNAP"
+#define SNAPSHOT_VERSION  1
+
+// Machine state that doesn't live in guest memory
+// Snapshot file is this header, unread terminal input, addresses of all allocated pages, and then the pages
+// themselves, starting at a PAGE_SIZE aligned offset. Fields are stored in host format
+struct SnapshotHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t page_count;
+  uint32_t input_size;
+  uint32_t gpr[GPR_CNT];
+  uint32_t csr[CSR_CNT];
+  uint32_t pending;
+  uint32_t last_i;
+  uint32_t timer_started;
+  uint64_t retired;
+  uint64_t timer_left;      // Instructions until the next virtual timer tick, UINT64_MAX if there is no deadline
+  uint64_t timer_ticks;
+};
+
+/*
+  Snapshot file
+  Loading maps the file privately and memory pages point straight into the mapping, so it costs the same for any
+  memory size and pages are copied by the kernel only when guest writes to them
+*/
+class Snapshot {
+
+  uint8_t* data = nullptr;
+  size_t size = 0;
+
+  // Sizes come from the file, so offsets are worked out in 64 bits where they can't wrap around
+  static uint64_t addressesEnd(uint32_t input_size, uint32_t page_count) {
+    return sizeof(SnapshotHeader) + (uint64_t)input_size + (uint64_t)page_count * 4;
+  }
+  static uint64_t pagesOffset(uint32_t input_size, uint32_t page_count) {
+    return (addressesEnd(input_size, page_count) + PAGE_MASK) & ~(uint64_t)PAGE_MASK;
+  }
+
+public:
+
+  Snapshot() {};
+  Snapshot(Snapshot&) = delete;
+  void operator=(const Snapshot&) = delete;
+  ~Snapshot() { close(); }
+
+  // These return false if the file can't be written or isn't a snapshot
+  static bool save(std::string file_name, SnapshotHeader& header, const std::string& input, const Memory& memory);
+  // Mapping is kept until close, memory can't be used after that
+  bool load(std::string file_name, SnapshotHeader& header, std::string& input, Memory& memory);
+  void close();
+
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <chrono>
+
+// Size of the input ring, has to be a power of two
+#define TERMINAL_RING_SIZE      4096
+// Output is written to the console when a line is finished, when this many characters are buffered,
+// and by the device thread every TERMINAL_FLUSH_MS milliseconds
+#define TERMINAL_OUT_THRESHOLD  256
+#define TERMINAL_FLUSH_MS       20
+
+/*
+  Terminal device
+  Device thread waits for input on stdin and pushes it to a single producer single consumer ring, so CPU only has
+  to look at the ring instead of making a syscall. Characters written to TERM_OUT are buffered and written in batches
+  In headless mode console is left alone and there is no device thread, input is a script read from a file or pipe
+  beforehand and output can go to a file
+*/
+class Terminal {
+
+  termios old_attr;
+  int old_flags = 0;
+  bool started = false;
+
+  bool headless = false;
+  std::string script;
+  size_t script_pos = 0;
+  int out_fd = STDOUT_FILENO;
+
+  std::thread* device_thread = nullptr;
+  std::atomic<bool> running{false};
+
+  // Device thread is the only producer and CPU the only consumer
+  uint8_t ring[TERMINAL_RING_SIZE];
+  std::atomic<uint32_t> head{0};    // Next slot to write to
+  std::atomic<uint32_t> tail{0};    // Next slot to read from
+
+  std::mutex out_mutex;
+  std::string out_buffer;
+
+  // Output is kept in memory instead of being written out, used to compare runs of the same program
+  bool capturing = false;
+  std::string captured;
+
+  void deviceBody();
+  void flushLocked();
+
+public:
+
+  Terminal() {};
+  Terminal(Terminal&) = delete;
+  void operator=(const Terminal&) = delete;
+  ~Terminal() { stop(); }
+
+  // Headless mode has to be set up before start, these return false if file can't be opened
+  // "-" as input file reads the script from stdin until it is closed
+  bool openInput(std::string file_name);
+  bool openOutput(std::string file_name);
+  void setHeadless() { headless = true; }
+
+  // Puts console into raw mode and starts the device thread
+  void start();
+  // Stops the device thread, writes out buffered output and restores console attributes
+  void stop();
+
+  // Script is read before the ring, so input restored from a snapshot comes before anything typed on the console
+  bool hasInput() const {
+    if ( script_pos < script.size() ) return true;
+    if ( headless ) return false;
+    return head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed);
+  }
+
+  // Takes next character from the script or the ring, returns false if there is none
+  bool readInput(uint8_t& c) {
+    if ( script_pos < script.size() ) {
+      c = script[script_pos++];
+      return true;
+    }
+    if ( headless ) return false;
+    uint32_t current = tail.load(std::memory_order_relaxed);
+    if ( head.load(std::memory_order_acquire) == current ) return false;
+    c = ring[current & (TERMINAL_RING_SIZE - 1)];
+    tail.store(current + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Input which guest hasn't read yet, saved in snapshots
+  void addInput(const std::string& input) { script.insert(script_pos, input); }
+  std::string takeInput();
+  // Replaces all unread input
+  void setInput(const std::string& input) { script = input; script_pos = 0; }
+
+  void startCapture() { flush(); capturing = true; captured.clear(); }
+  const std::string& getCaptured() const { return captured; }
+  void clearCaptured() { captured.clear(); }
+
+  void output(char c);
+  void output(const std::string& text);
+  void flush();
+
+};
+
+#endif
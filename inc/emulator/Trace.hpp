@@ -0,0 +1,162 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "ComputerSystem.hpp"
+
+/*
+  Instruction trace file
+  File starts with the magic and version, and then holds compressed chunks, each is its raw size, its compressed
+  size and the compressed bytes. Records never cross chunks, but decoding state carries over from one to the next
+  Record for every retired instruction starts with a flags byte, and then holds only what can't be worked out from
+  the previous records:
+    TRACE_JUMP        - PC isn't the one after the previous instruction, zigzag varint of the difference follows
+    TRACE_WORD        - instruction word follows(4 bytes), first time this address is executed or if it has changed
+    TRACE_INTERRUPT   - interrupt was entered after the instruction, cause byte follows
+    TRACE_REGS        - varint mask of general purpose registers written(PC excluded) follows, and then a zigzag
+                        varint of the change of each of them, lowest register first. Writes by interrupt entry that
+                        followed the instruction are included
+  Varints are little endian groups of 7 bits, high bit set on every byte except the last
+*/
+
+#define TRACE_MAGIC       0x45435254494d5341ull   // "ASMITRCE"
+#define TRACE_VERSION     1
+
+#define TRACE_JUMP        0x01
+#define TRACE_WORD        0x02
+#define TRACE_INTERRUPT   0x04
+#define TRACE_REGS        0x08
+
+// Chunk is handed over to the writer thread once it grows past TRACE_CHUNK_SIZE, TRACE_CHUNKS of them make up the ring
+#define TRACE_CHUNK_SIZE  (64 * 1024)
+#define TRACE_CHUNKS      16
+#define TRACE_RECORD_MAX  96
+
+// Compressor looks for earlier matches through a hash table of 4 byte sequences
+#define TRACE_HASH_BITS   14
+
+/*
+  Compression
+  Byte oriented LZ77. Every sequence is a token(literal count in the high nibble, match length - 4 in the low one,
+  15 means more length bytes follow, each adding up to 255), the literals, and a 2 byte offset back to the match
+  Last sequence has only literals
+*/
+class TraceCompression {
+public:
+  static void compress(const uint8_t* in, uint32_t size, std::vector<uint8_t>& out);
+  // Returns false if compressed data doesn't decode to exactly raw_size bytes
+  static bool decompress(const uint8_t* in, uint32_t size, std::vector<uint8_t>& out, uint32_t raw_size);
+};
+
+/*
+  Trace writer
+  Records are encoded on the emulation thread into a ring of chunks, and a writer thread compresses full chunks and
+  writes them out. Emulation waits only when all chunks are full, so nothing is ever dropped
+*/
+class TraceWriter {
+
+  struct WordPage {
+    uint32_t words[PAGE_SIZE / 4];
+    uint8_t seen[PAGE_SIZE / 4] = {};
+  };
+
+  std::ofstream fout;
+  std::vector<uint8_t> chunks[TRACE_CHUNKS];
+  // Chunks in [drained, filled) wait for the writer, chunk filled % TRACE_CHUNKS is being filled
+  std::atomic<uint64_t> filled{0};
+  std::atomic<uint64_t> drained{0};
+  std::thread* writer = nullptr;
+  bool finished = false;
+  std::mutex ring_mutex;
+  std::condition_variable ring_cv;
+
+  // Decoding state that reader keeps as well
+  uint32_t expected_pc = 0;
+  uint32_t regs[GPR_CNT] = {};
+  PageTable<WordPage> words;
+
+  // Instruction whose record is written once its register writes are known, at the start of the next one
+  bool pending = false;
+  uint32_t pending_pc = 0;
+  uint32_t pending_word = 0;
+  int pending_interrupt = -1;
+
+  uint64_t records = 0;
+  uint64_t raw_bytes = 0;
+  uint64_t written_bytes = 0;
+
+  void writeRecord(const uint32_t* gpr);
+  void publish();
+  void writerBody();
+
+public:
+
+  TraceWriter() {};
+  TraceWriter(TraceWriter&) = delete;
+  void operator=(const TraceWriter&) = delete;
+  ~TraceWriter() { finish(nullptr); }
+
+  // Returns false if the file can't be created
+  bool open(std::string file_name);
+
+  // Called before every instruction executes, with the registers as they are at that point
+  void step(uint32_t pc, uint32_t word, const uint32_t* gpr) {
+    if ( pending ) writeRecord(gpr);
+    pending = true;
+    pending_pc = pc;
+    pending_word = word;
+  }
+
+  void interrupted(uint8_t cause) { if ( pending ) pending_interrupt = cause; }
+
+  // Writes the last record(registers are needed for it) and everything still in the ring, and stops the writer
+  void finish(const uint32_t* gpr);
+
+  uint64_t getRecords() const { return records; };
+  uint64_t getRawBytes() const { return raw_bytes; };
+  uint64_t getWrittenBytes() const { return written_bytes; };
+
+};
+
+// One decoded record, gpr holds register values after the instruction, except for PC which is its address
+struct TraceRecord {
+  uint32_t pc;
+  uint32_t word;
+  int interrupt;        // Cause of the interrupt entered after the instruction, or -1
+  uint32_t written;     // Mask of registers the instruction wrote
+  uint32_t gpr[GPR_CNT];
+};
+
+class TraceReader {
+
+  std::ifstream fin;
+  std::vector<uint8_t> chunk;
+  size_t position = 0;
+  bool damaged = false;
+
+  uint32_t expected_pc = 0;
+  uint32_t regs[GPR_CNT] = {};
+  std::unordered_map<uint32_t, uint32_t> words;
+
+  bool readChunk();
+  bool readVarint(uint32_t& value);
+
+public:
+
+  // Returns false if the file isn't a trace
+  bool open(std::string file_name);
+  // Returns false at the end of the trace, or if it is damaged
+  bool next(TraceRecord& record);
+  bool isDamaged() const { return damaged; };
+
+};
+
+#endif
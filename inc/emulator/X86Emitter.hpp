@@ -0,0 +1,98 @@
+#ifndef X86EMITTER_H
+#define X86EMITTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// x86-64 general purpose registers, in encoding order
+enum HostReg {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Condition codes used with jcc
+enum HostCond {
+  COND_AE = 0x3,
+  COND_E  = 0x4,
+  COND_NE = 0x5,
+  COND_A  = 0x7,
+  COND_G  = 0xf
+};
+
+// Writes encoded x86-64 instructions into a buffer
+// All register operands are 32 bit unless the name says otherwise, memory operands are [base + disp] or [base + index * scale]
+class X86Emitter {
+
+  uint8_t* buffer;
+  size_t capacity;
+  size_t pos = 0;
+
+  void byte(uint8_t b) { if ( pos < capacity ) buffer[pos] = b; pos++; }
+  void dword(uint32_t d) { for ( int i = 0; i < 4; i++ ) byte(d >> 8 * i); }
+  void qword(uint64_t q) { for ( int i = 0; i < 8; i++ ) byte(q >> 8 * i); }
+
+  void rex(bool w, int reg, int index, int base);
+  void modrmReg(int reg, int rm) { byte(0xc0 | (reg & 7) << 3 | (rm & 7)); }
+  void modrmMem(int reg, int base, int32_t disp);
+  void modrmIndex(int reg, int base, int index, int scale);
+
+public:
+
+  X86Emitter(uint8_t* buffer, size_t capacity) : buffer(buffer), capacity(capacity) {};
+
+  size_t size() const { return pos; }
+  bool overflowed() const { return pos > capacity; }
+
+  void mov(int dst, int src);
+  void mov64(int dst, int src);
+  void movImm(int dst, uint32_t imm);
+  void movImm64(int dst, uint64_t imm);
+  void load(int dst, int base, int32_t disp);
+  void store(int base, int32_t disp, int src);
+  void storeImm(int base, int32_t disp, uint32_t imm);
+  void loadIndex(int dst, int base, int index);
+  void storeIndex(int base, int index, int src);
+  void load64Index8(int dst, int base, int index);
+  void cmpByteIndexZero(int base, int index);
+  void storeByteIndexOne(int base, int index);
+
+  // op r/m32, r32 forms
+  void add(int dst, int src) { alu(0x01, dst, src); }
+  void sub(int dst, int src) { alu(0x29, dst, src); }
+  void andr(int dst, int src) { alu(0x21, dst, src); }
+  void orr(int dst, int src) { alu(0x09, dst, src); }
+  void xorr(int dst, int src) { alu(0x31, dst, src); }
+  void cmp(int dst, int src) { alu(0x39, dst, src); }
+  void alu(uint8_t opcode, int dst, int src);
+
+  // op r/m32, imm32 forms, ext is the opcode extension in reg field
+  void addImm(int dst, uint32_t imm) { aluImm(0, dst, imm); }
+  void andImm(int dst, uint32_t imm) { aluImm(4, dst, imm); }
+  void cmpImm(int dst, uint32_t imm) { aluImm(7, dst, imm); }
+  void aluImm(int ext, int dst, uint32_t imm);
+
+  void imul(int dst, int src);
+  void notr(int reg);
+  void shlCl(int reg) { shift(4, reg); }
+  void shrCl(int reg) { shift(5, reg); }
+  void shift(int ext, int reg);
+  void shrImm(int reg, uint8_t imm);
+  void cdq() { byte(0x99); }
+  void idiv(int reg);
+  void test64(int a, int b);
+
+  // Jumps return position of their rel32 field, which is later set with patch
+  size_t jcc(int cond);
+  size_t jmp();
+  void patch(size_t at);
+
+  void call(int reg);
+  void push(int reg);
+  void pop(int reg);
+  void subRsp(uint8_t imm);
+  void addRsp(uint8_t imm);
+  void ret() { byte(0xc3); }
+
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TRANSLATOR_H
+#define TRANSLATOR_H
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <fstream>
+#include <sstream>
+#include "../elf/Elf32File.hpp"
+#include "../emulator/ComputerSystem.hpp"
+#include "../emulator/BlockCache.hpp"
+
+/*
+  Ahead of time translator
+  Loads an executable the same way emulator does and translates every block it can find into a C++ function
+  Blocks are found with the emulator's own block cache, so their bounds match the ones emulator will translate
+  Starting points are the entry, successors of translated blocks, and every word in the image which looks like
+  an address inside a loaded segment(literal pool entries of jumps, calls and handler addresses)
+  Blocks reached only through computed addresses are left to the interpreter at runtime
+*/
+
+class Translator {
+
+  std::string file_name;
+  std::string output_name = "";
+
+  Memory memory;
+  BlockCache block_cache;
+  // Loaded segments, as (start, end) address pairs
+  std::vector<std::pair<uint32_t, uint32_t>> segments;
+
+  std::vector<uint32_t> worklist;
+  std::unordered_set<uint32_t> found;
+  std::vector<Block*> blocks;
+
+  uint32_t translated = 0;
+  uint32_t rejected = 0;
+
+  void printError(std::string message) {
+    std::cout << "translator: error : " << message << std::endl;
+    exit(-1);
+  }
+
+  void loadSegments();
+  void findBlocks();
+  void addCandidate(uint32_t address);
+  bool inSegment(uint32_t address) const;
+  void writeOutput();
+  bool translateBlock(std::ostream& os, const Block& block);
+  bool translateInstruction(std::ostream& os, const DecodedInstr& d, uint32_t next_pc, uint32_t retired, bool last);
+
+protected:
+
+  Translator() {};
+
+  static Translator* translator;
+
+public:
+
+  Translator(Translator&) = delete;
+  void operator=(const Translator&) = delete;
+  static Translator* getInstance();
+
+  void setFileName(std::string name) { file_name = name; };
+  void setOutputName(std::string name) { output_name = name; };
+  void startTranslating();
+
+};
+
+#endif
@@ -41,6 +41,7 @@ Assembler* assembler = Assembler::getInstance();
 %token HALT
 %token INT
 %token IRET
+%token WFI
 %token CALL
 %token RET
 %token JMP
@@ -207,6 +208,11 @@ instruction:
 	instr->type = Types::IRET;
 	$$ = instr;
 }
+| WFI {
+	struct Instruction* instr = new struct Instruction();
+	instr->type = Types::WFI;
+	$$ = instr;
+}
 | RET {
 	struct Instruction* instr = new struct Instruction();
 	instr->type = Types::RET;
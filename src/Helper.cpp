@@ -71,4 +71,14 @@ void Helper::printHex(std::ostream& os, uint32_t number, int width, bool prefix)
     else os << std::setw(width) << number;
 
     os.copyfmt(old_state);
-}
\ No newline at end of file
+}
+
+// FNV-1a, used to tell apart outputs of guest programs
+uint32_t Helper::hashString(const std::string& string) {
+    uint32_t hash = 2166136261u;
+    for ( char c : string ) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
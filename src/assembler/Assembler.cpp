@@ -157,6 +157,11 @@ void Assembler::addInstruction(Instruction instruction) {
             addWordToCurrentSection(opcode2);
             break;
         }
+        case Types::WFI: {
+            uint32_t opcode = 0x11000000;
+            addWordToCurrentSection(opcode);
+            break;
+        }
         case Types::RET: {
             uint32_t opcode = 0x93FE0004;
             addWordToCurrentSection(opcode);
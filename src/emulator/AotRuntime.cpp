@@ -0,0 +1,32 @@
+#include "../../inc/emulator/AotRuntime.hpp"
+
+std::atomic<uint64_t> AotRuntime::attached{0};
+
+// Function local, so generated blocks can be registered from static initializers in any order
+std::unordered_map<uint32_t, const AotBlock*>& AotRuntime::registry() {
+  static std::unordered_map<uint32_t, const AotBlock*> blocks;
+  return blocks;
+}
+
+void AotRuntime::add(const AotBlock* blocks, size_t count) {
+  for ( size_t i = 0; i < count; i++ ) {
+    registry()[blocks[i].start] = &blocks[i];
+  }
+}
+
+bool AotRuntime::attach(Block& block, const Memory& memory) {
+  if ( empty() ) return false;
+
+  auto it = registry().find(block.start);
+  if ( it == registry().end() ) return false;
+
+  const AotBlock& aot = *it->second;
+  if ( aot.size != block.size ) return false;
+  for ( uint32_t i = 0; i < aot.length; i++ ) {
+    if ( memory.readWord(block.start + i * 4) != aot.words[i] ) return false;
+  }
+
+  block.native = aot.function;
+  attached++;
+  return true;
+}
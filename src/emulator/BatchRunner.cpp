@@ -0,0 +1,119 @@
+#include "../../inc/emulator/BatchRunner.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+BatchRunner::~BatchRunner() {
+  for ( auto& image : images ) unlink(image.second.c_str());
+}
+
+void BatchRunner::readJobs(std::string list_file) {
+  std::ifstream fin(list_file);
+  if ( !fin.is_open() ) {
+    printError("could not open job list '" + list_file + "'");
+  }
+
+  std::string line;
+  while ( std::getline(fin, line) ) {
+    std::istringstream fields(line);
+    BatchJob job;
+    if ( !(fields >> job.executable) || job.executable[0] == '#' ) continue;
+    fields >> job.input >> job.output;
+    if ( job.input == "-" ) job.input = "";
+    jobs.push_back(job);
+  }
+}
+
+// Executable is loaded into a machine which never runs, and its state is saved right away
+void BatchRunner::prepareImages() {
+  for ( BatchJob& job : jobs ) {
+    if ( images.count(job.executable) || image_errors.count(job.executable) ) continue;
+
+    char path[] = "/tmp/emulator-batch-XXXXXX";
+    int fd = mkstemp(path);
+    if ( fd < 0 ) {
+      image_errors[job.executable] = "could not create a temporary file";
+      continue;
+    }
+    close(fd);
+
+    Emulator loader;
+    if ( !loader.loadExecutable(job.executable) || !loader.saveSnapshot(path) ) {
+      image_errors[job.executable] = loader.getError();
+      unlink(path);
+      continue;
+    }
+    images[job.executable] = path;
+  }
+}
+
+void BatchRunner::workerBody() {
+  while ( true ) {
+    size_t index = next_job.fetch_add(1);
+    if ( index >= jobs.size() ) break;
+    BatchJob& job = jobs[index];
+
+    auto failed = image_errors.find(job.executable);
+    if ( failed != image_errors.end() ) {
+      job.error = failed->second;
+      continue;
+    }
+
+    Emulator machine;
+    machine.copySettings(settings);
+    if ( !machine.loadSnapshot(images.at(job.executable)) ) {
+      job.error = machine.getError();
+      continue;
+    }
+    if ( job.input != "" ) machine.setInputFile(job.input);
+    machine.captureOutput();
+
+    job.halted = machine.run(limit);
+    if ( machine.getError() != "" ) {
+      job.error = machine.getError();
+      continue;
+    }
+    job.retired = machine.getRetired();
+    job.captured = machine.getOutput();
+
+    if ( job.output != "" ) {
+      std::ofstream fout(job.output, std::ios::binary | std::ios::trunc);
+      fout << job.captured;
+      if ( !fout ) job.error = "could not write output file '" + job.output + "'";
+    }
+  }
+}
+
+void BatchRunner::run() {
+  prepareImages();
+
+  std::vector<std::thread> pool;
+  for ( unsigned i = 0; i < workers; i++ ) {
+    pool.emplace_back(&BatchRunner::workerBody, this);
+  }
+  for ( std::thread& worker : pool ) worker.join();
+}
+
+void BatchRunner::printResults(double seconds) const {
+  uint64_t halted = 0;
+  uint64_t failed = 0;
+
+  for ( const BatchJob& job : jobs ) {
+    std::cout << "batch: " << job.executable;
+    if ( job.input != "" ) std::cout << " < " << job.input;
+    if ( job.error != "" ) {
+      failed++;
+      std::cout << ": error : " << job.error << "\n";
+      continue;
+    }
+    if ( job.halted ) halted++;
+    std::cout << ": " << (job.halted ? "halted" : "stopped at the limit") << " after " << job.retired << " instructions, "
+              << job.captured.size() << " bytes of output(hash ";
+    Helper::printHex(std::cout, Helper::hashString(job.captured), 10, true);
+    std::cout << ")\n";
+  }
+
+  std::cout << "Batch: " << jobs.size() << " programs on " << workers << " workers, " << halted << " halted, "
+            << jobs.size() - halted - failed << " stopped at the limit, " << failed << " failed, " << std::fixed
+            << std::setprecision(3) << seconds << " s" << std::endl;
+}
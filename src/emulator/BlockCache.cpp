@@ -0,0 +1,103 @@
+#include "../../inc/emulator/BlockCache.hpp"
+#include "../../inc/emulator/AotRuntime.hpp"
+
+#define CODE_MAP_SIZE (1u << (32 - PAGE_BITS))
+
+BlockCache::BlockCache() {
+  code_map = (uint8_t*)calloc(CODE_MAP_SIZE, 1);
+}
+
+BlockCache::~BlockCache() {
+  flush();
+  free(code_map);
+}
+
+bool BlockCache::endsBlock(const DecodedInstr& decoded) {
+  switch (decoded.op) {
+    // Control transfers, instructions which raise interrupts and wait for them
+    case OP_HALT: case OP_INT: case OP_WFI: case OP_INVALID:
+    case OP_CALL: case OP_CALL_MEM:
+    case OP_JMP: case OP_BEQ: case OP_BNE: case OP_BGT:
+    case OP_JMP_MEM: case OP_BEQ_MEM: case OP_BNE_MEM: case OP_BGT_MEM:
+      return true;
+    // CSR writes can unmask interrupts or set the handler address
+    case OP_CSRWR: case OP_CSR_OR: case OP_CSR_LD_MEM: case OP_CSR_POP: case OP_IRET:
+      return true;
+    // Anything else ends the block only if it writes to PC
+    case OP_XCHG:
+      return decoded.reg_B == PC || decoded.reg_C == PC;
+    case OP_LD_POP:
+      return decoded.reg_A == PC || decoded.reg_B == PC;
+    case OP_ST: case OP_ST_MEM:
+      return false;
+    default:
+      return decoded.reg_A == PC;
+  }
+}
+
+Block* BlockCache::translate(const Memory& memory, uint32_t pc) {
+  Block* block = new Block();
+  block->start = pc;
+
+  while ( true ) {
+    DecodedInstr decoded;
+    DecodeCache::decode(memory.readWord(pc), decoded);
+    DecodeCache::fuse(memory, pc, decoded, false);
+    block->ops.push_back(decoded);
+    switch (decoded.op) {
+      case OP_CALL: case OP_CALL_MEM: case OP_ST: case OP_ST_PUSH: case OP_ST_MEM:
+      case OP_CSRWR: case OP_CSR_OR: case OP_CSR_LD_MEM: case OP_CSR_POP: case OP_IRET:
+      case OP_HALT: case OP_INT: case OP_WFI: case OP_INVALID:
+        block->side_effects = true;
+        break;
+    }
+
+    markCode(pc);
+    markCode(pc + 3);
+    pc += 4;
+
+    if ( endsBlock(decoded) || block->ops.size() == BLOCK_MAX_INSTRUCTIONS || (pc & PAGE_MASK) < 4 ) break;
+  }
+
+  // Pop into PC was fused with the word after it, so that word is part of the block as well
+  if ( block->ops.back().op == OP_IRET ) {
+    markCode(pc);
+    markCode(pc + 3);
+  }
+
+  block->end = pc;
+  block->size = block->ops.size();
+
+  // Loop can continue past the end of this block, but it is always on the same page
+  block->idiom = LoopIdiom::recognize(memory, block->start);
+
+  DecodedInstr end_marker = {};
+  end_marker.op = OP_BLOCK_END;
+  block->ops.push_back(end_marker);
+
+  // Block could have been translated ahead of time
+  AotRuntime::attach(*block, memory);
+
+  blocks[block->start] = block;
+  translated++;
+  return block;
+}
+
+void BlockCache::countBlock(const Block& block, uint64_t* ops) {
+  for ( uint32_t i = 0; i < block.size; i++ ) ops[block.ops[i].op] += block.runs;
+}
+
+void BlockCache::countOps(uint64_t* ops) const {
+  for ( int i = 0; i < OP_COUNT; i++ ) ops[i] += op_counts[i];
+  for ( auto& entry : blocks ) countBlock(*entry.second, ops);
+}
+
+void BlockCache::flush() {
+  for ( auto& entry : blocks ) {
+    countBlock(*entry.second, op_counts);
+    delete entry.second;
+  }
+  blocks.clear();
+  memset(code_map, 0, CODE_MAP_SIZE);
+  flushes++;
+}
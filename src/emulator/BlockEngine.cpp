@@ -0,0 +1,162 @@
+#include "../../inc/emulator/Emulator.hpp"
+
+/*
+  Block translation engine
+  Instructions are executed from translated blocks with threaded dispatch. When a block ends, execution continues
+  into its chained successor, so hot loops never go back through the block lookup. Interrupts, terminal input and
+  stores to translated code are checked only at block boundaries, stores to code leave the block right away
+  With JIT enabled, blocks entered JIT_HOT_THRESHOLD times are compiled and from then on run natively
+*/
+
+#ifdef __GNUC__
+
+void Emulator::runBlocks() {
+
+  uint32_t* gpr = cpu.gpr;
+  uint32_t* csr = cpu.csr;
+  int32_t poll_countdown = TERMINAL_POLL_INTERVAL;
+  // Instructions the block executed, loop idiom runs many iterations of it at once
+  uint32_t executed;
+  Block* block;
+  const DecodedInstr* d;
+
+  // PC is advanced before every micro op, as it would be by fetch, block end marker takes back that advance
+  #define DISPATCH() \
+    do { \
+      d++; \
+      gpr[PC] += 4; \
+      goto *handlers[d->op]; \
+    } while(0)
+
+  #define STORE(addr) \
+    do { \
+      storeWord(addr, gpr[d->reg_C]); \
+      if ( code_written ) { advanceTime(d - block->ops.data() + 1); goto leave; } \
+    } while(0)
+
+  // Timer is started only after handler address has been set
+  #define CSR_WRITTEN() \
+    do { \
+      if ( !timer_started && csr[HANDLER] != 0 ) startTimer(); \
+    } while(0)
+
+  // Instructions of the block up to and including the halt have retired
+  #define HALT() do { advanceTime(d - block->ops.data() + 1); halted = true; return; } while(0)
+
+  // Wait for interrupt always ends its block, time is accounted for before sleeping
+  #define WAIT() \
+    do { \
+      advanceTime(block->size); \
+      waitForInterrupt(); \
+      goto leave; \
+    } while(0)
+
+  // Block ends are checked instead, so native code behaves the same
+  #define JUMPED()
+
+  // Blocks are translated without pairs, every micro op is one instruction
+  #define PAIRED() false
+
+  goto start;
+
+  #include "OpHandlers.inc"
+
+native:
+  executed = block->native(gpr, this);
+  if ( executed != JIT_EXIT_NEXT ) {
+    // Store hit translated code, the rest of the block runs again from a new one
+    advanceTime(executed);
+    goto leave;
+  }
+  executed = block->size;
+  goto block_done;
+
+op_block_end:
+  gpr[PC] -= 4;
+  if ( lockstep_block ) finishLockstep();
+
+block_done: {
+  advanceTime(executed);
+  if ( retired >= run_limit ) return;
+  poll_countdown -= executed;
+  if ( poll_countdown <= 0 ) {
+    poll_countdown = TERMINAL_POLL_INTERVAL;
+    handleTerminal();
+    armIdle();
+    pollRequests();
+  }
+
+  // Stores from native code don't go through storeWord, so blocks with side effects stop idle detection
+  if ( idle_state ) {
+    if ( block->side_effects ) idle_state = IDLE_OFF;
+    else checkIdle(gpr[PC]);
+    // Idle wait can skip ahead to the end of the run
+    if ( retired >= run_limit ) return;
+  }
+  if ( cpu.interruptPending() || code_written ) goto leave;
+
+  Block* next = block->successor(gpr[PC]);
+  if ( !next ) {
+    next = block_cache.get(memory, gpr[PC]);
+    block->chain(next);
+  }
+  block = next;
+  goto enter;
+}
+
+leave:
+  if ( lockstep_block ) finishLockstep();
+  checkInterrupts();
+  // Interrupt entry pushes to the stack, so this is checked after it
+  if ( code_written ) {
+    block_cache.flush();
+    jit.reset();
+    code_written = false;
+  }
+  // Blocks left early and waits count their own instructions
+  if ( retired >= run_limit ) return;
+start:
+  block = block_cache.get(memory, gpr[PC]);
+enter:
+  if ( block->idiom && loop_idioms ) {
+    executed = runIdiom(*block->idiom);
+    if ( executed ) goto block_done;
+  }
+  executed = block->size;
+  block->runs++;
+  if ( block->native ) {
+    if ( !jit_lockstep ) goto native;
+    startLockstep(block);
+  } else if ( engine == ENGINE_JIT && ++block->exec_count == JIT_HOT_THRESHOLD ) {
+    // Block is entered again as native code, that run counts once
+    if ( jit.compile(*block) ) {
+      block->runs--;
+      goto enter;
+    }
+    // Out of space for native code, all translations are dropped and compiled again when they get hot
+    if ( jit.isFull() ) {
+      code_written = true;
+      goto leave;
+    }
+  }
+  d = block->ops.data();
+  gpr[PC] += 4;
+  goto *handlers[d->op];
+
+  #undef DISPATCH
+  #undef STORE
+  #undef CSR_WRITTEN
+  #undef HALT
+  #undef WAIT
+  #undef JUMPED
+  #undef PAIRED
+}
+
+#else
+
+// Labels as values are not available, block engine falls back to the switch loop
+void Emulator::runBlocks() {
+  runSwitch();
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "../../inc/emulator/CallGraph.hpp"
+
+void CallGraph::resolve(uint32_t pc) {
+  if ( pending == PENDING_CALL ) {
+    push(pc, last_pc, last_pc + 4, FRAME_CALL);
+  } else if ( pending == PENDING_RETURN ) {
+    // Pop pc which doesn't go back to any call site is only a jump
+    for ( size_t i = stack.size(); i > 0; i-- ) {
+      if ( stack[i - 1].kind == FRAME_ENTRY || stack[i - 1].return_address != pc ) continue;
+      while ( stack.size() >= i ) pop();
+      break;
+    }
+  }
+  pending = PENDING_NONE;
+
+  // Execution either starts here, or the last interrupt handler returned to code that was entered before tracking
+  if ( stack.empty() ) push(pc, 0, 0, FRAME_ENTRY);
+}
+
+void CallGraph::push(uint32_t function, uint32_t call_site, uint32_t return_address, int kind) {
+  Frame frame = { function, call_site, return_address, kind, 0, 0 };
+  stack.push_back(frame);
+  if ( kind == FRAME_INTERRUPT ) functions[function].interrupts++;
+}
+
+void CallGraph::pop() {
+  Frame frame = stack.back();
+  stack.pop_back();
+
+  functions[frame.function].self += frame.self;
+  if ( frame.kind != FRAME_CALL || stack.empty() ) return;
+
+  uint64_t inclusive = frame.self + frame.children;
+  stack.back().children += inclusive;
+  CallCost& call = functions[stack.back().function].calls[std::make_pair(frame.call_site, frame.function)];
+  call.count++;
+  call.inclusive += inclusive;
+}
+
+void CallGraph::interrupted(uint32_t return_address, uint32_t handler) {
+  if ( pending || stack.empty() ) resolve(return_address);
+  push(handler, 0, return_address, FRAME_INTERRUPT);
+}
+
+bool CallGraph::writeCallgrind(std::string file_name, const Profiler& symbols) {
+  while ( !stack.empty() ) pop();
+
+  std::ofstream fout(file_name, std::ios::trunc);
+  if ( !fout.is_open() ) return false;
+
+  fout << "# callgrind format\n"
+       << "version: 1\n"
+       << "creator: emulator\n"
+       << "positions: instr\n"
+       << "events: Instructions\n"
+       << "summary: " << total << "\n";
+
+  for ( auto& function : functions ) {
+    fout << "\n";
+    if ( function.second.interrupts ) {
+      fout << "# entered by " << function.second.interrupts << " interrupts\n";
+    }
+    fout << "fn=" << symbols.addressName(function.first) << "\n";
+    Helper::printHex(fout, function.first, 10, true);
+    fout << " " << function.second.self << "\n";
+
+    for ( auto& call : function.second.calls ) {
+      fout << "cfn=" << symbols.addressName(call.first.second) << "\n"
+           << "calls=" << call.second.count << " ";
+      Helper::printHex(fout, call.first.second, 10, true);
+      fout << "\n";
+      Helper::printHex(fout, call.first.first, 10, true);
+      fout << " " << call.second.inclusive << "\n";
+    }
+  }
+
+  fout.close();
+  return !fout.fail();
+}
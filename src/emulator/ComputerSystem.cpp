@@ -0,0 +1,16 @@
+#include "../../inc/emulator/ComputerSystem.hpp"
+
+const Memory::Page Memory::zero_page;
+
+void Memory::trackDirtyPages() {
+  if ( !dirty_map ) dirty_map = (uint8_t*)calloc(1u << (32 - PAGE_BITS), 1);
+}
+
+void Memory::checkpoint() {
+  trackDirtyPages();
+  checkpoint_pages.clear();
+  pages.forEach([&](uint32_t address, const Page& page) {
+    memcpy(checkpoint_pages.get(address)->bytes, page.bytes, PAGE_SIZE);
+  });
+  memset(dirty_map, 0, 1u << (32 - PAGE_BITS));
+}
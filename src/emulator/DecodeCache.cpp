@@ -0,0 +1,92 @@
+#include "../../inc/emulator/DecodeCache.hpp"
+#include "../../inc/emulator/Emulator.hpp"
+
+uint8_t DecodeCache::decodeOp(uint8_t oc_mod) {
+  switch (oc_mod) {
+    case 0x00: return OP_HALT;
+    case 0x10: return OP_INT;
+    case 0x11: return OP_WFI;
+    case 0x20: return OP_CALL;
+    case 0x21: return OP_CALL_MEM;
+    case 0x30: return OP_JMP;
+    case 0x31: return OP_BEQ;
+    case 0x32: return OP_BNE;
+    case 0x33: return OP_BGT;
+    case 0x38: return OP_JMP_MEM;
+    case 0x39: return OP_BEQ_MEM;
+    case 0x3a: return OP_BNE_MEM;
+    case 0x3b: return OP_BGT_MEM;
+    case 0x40: return OP_XCHG;
+    case 0x50: return OP_ADD;
+    case 0x51: return OP_SUB;
+    case 0x52: return OP_MUL;
+    case 0x53: return OP_DIV;
+    case 0x60: return OP_NOT;
+    case 0x61: return OP_AND;
+    case 0x62: return OP_OR;
+    case 0x63: return OP_XOR;
+    case 0x70: return OP_SHL;
+    case 0x71: return OP_SHR;
+    case 0x80: return OP_ST;
+    case 0x81: return OP_ST_PUSH;
+    case 0x82: return OP_ST_MEM;
+    case 0x90: return OP_CSRRD;
+    case 0x91: return OP_LD_REG;
+    case 0x92: return OP_LD_MEM;
+    case 0x93: return OP_LD_POP;
+    case 0x94: return OP_CSRWR;
+    case 0x95: return OP_CSR_OR;
+    case 0x96: return OP_CSR_LD_MEM;
+    case 0x97: return OP_CSR_POP;
+    default: return OP_INVALID;
+  }
+}
+
+void DecodeCache::decode(uint32_t instr, DecodedInstr& decoded) {
+  decoded.instr = instr;
+  decoded.disp = Emulator::extractDisplacement(instr);
+  decoded.reg_A = Emulator::extractRegA(instr);
+  decoded.reg_B = Emulator::extractRegB(instr);
+  decoded.reg_C = Emulator::extractRegC(instr);
+  decoded.op = decodeOp(Emulator::extractOcMod(instr));
+}
+
+/*
+  Fusion matches what the assembler emits for iret, runs of push and pop, and ld of a symbol's memory contents(the
+  address from the literal pool is loaded first and then the value from it)
+  Fused handlers run the two instructions one after the other, so only PC has to be left out, it isn't advanced
+  between them
+*/
+void DecodeCache::fuse(const Memory& memory, uint32_t pc, DecodedInstr& decoded, bool pairs) {
+  if ( decoded.op != OP_LD_POP && decoded.op != OP_ST_PUSH && decoded.op != OP_LD_MEM ) return;
+
+  uint32_t next_instr = memory.readWord(pc + 4);
+  if ( decoded.instr == 0x93FE0004 ) {
+    if ( next_instr == 0x970E0004 ) decoded.op = OP_IRET;
+    return;
+  }
+  if ( !pairs ) return;
+
+  DecodedInstr next;
+  decode(next_instr, next);
+  if ( next.op != decoded.op ) return;
+
+  switch (decoded.op) {
+    case OP_ST_PUSH:
+      if ( next.reg_A != decoded.reg_A || next.disp != decoded.disp || decoded.reg_A == PC || next.reg_C == PC ) return;
+      decoded.op = OP_PUSH_PAIR;
+      decoded.reg_B = next.reg_C;
+      break;
+    case OP_LD_POP:
+      if ( next.reg_B != decoded.reg_B || next.disp != decoded.disp || decoded.reg_B == PC
+        || decoded.reg_A == PC || next.reg_A == PC ) return;
+      decoded.op = OP_POP_PAIR;
+      decoded.reg_C = next.reg_A;
+      break;
+    case OP_LD_MEM:
+      if ( next.reg_A != decoded.reg_A || next.reg_B != decoded.reg_A || next.reg_C != decoded.reg_C || next.disp != 0
+        || decoded.reg_A == PC || decoded.reg_C == PC ) return;
+      decoded.op = OP_LD_INDIRECT;
+      break;
+  }
+}
@@ -0,0 +1,21 @@
+#include "../../inc/emulator/DeviceBus.hpp"
+
+DeviceBus::DeviceBus() {
+  for ( uint32_t i = 0; i < DEVICE_SLOTS; i++ ) slots[i] = -1;
+}
+
+bool DeviceBus::attach(const Device& device) {
+  if ( device.base < DEVICE_BASE || device.size == 0 || device.size > 0 - device.base ) return false;
+  if ( (device.base | device.size) & 3 ) return false;
+  if ( devices.size() >= INT8_MAX ) return false;
+
+  uint32_t first = (device.base - DEVICE_BASE) >> 2;
+  uint32_t count = device.size >> 2;
+  for ( uint32_t i = first; i < first + count; i++ ) {
+    if ( slots[i] >= 0 ) return false;
+  }
+
+  for ( uint32_t i = first; i < first + count; i++ ) slots[i] = devices.size();
+  devices.push_back(device);
+  return true;
+}
@@ -1,89 +1,346 @@
 #include "../../inc/emulator/Emulator.hpp"
 
-Emulator* Emulator::emulator = nullptr;
 uint32_t Emulator::timer_periods[8] = {500, 1000, 1500, 2000, 5000, 10000, 30000, 60000};
-bool Emulator::cpu_on = false;
+std::atomic<uint32_t> Emulator::stats_requests{0};
 
-Emulator* Emulator::getInstance() {
-  if ( emulator == nullptr ) {
-    emulator = new Emulator();
-  }
-
-  return emulator;
+Emulator::Emulator() {
+  devices.attach({ "terminal", MM_REGS_BASE + TERM_OUT * 4, 8, this, nullptr, terminalWrite });
+  devices.attach({ "timer", MM_REGS_BASE + TIM_CFG * 4, 4, this, nullptr, timerWrite });
+  devices.attach({ "host", HOST_REGS_BASE, HOST_REGS_CNT * 4, this, nullptr, hostWrite });
 }
 
-void Emulator::loadMemory() {
+void Emulator::copySettings(const Emulator& other) {
+  engine = other.engine;
+  jit_lockstep = other.jit_lockstep;
+  virtual_timer = other.virtual_timer;
+  timer_rate = other.timer_rate;
+  idle_skip = other.idle_skip;
+  loop_idioms = other.loop_idioms;
+  host_dir = other.host_dir;
+  headless = other.headless;
+  input_interval = other.input_interval;
+  input_interval_ms = other.input_interval_ms;
+}
 
-  Elf32File file(file_name, 0, true);
-  file.readFromFile();
+bool Emulator::loadMemory() {
 
-  if ( file.getType() != ET_EXEC ) {
+  if ( !image.load(file_name, memory) ) {
     // Error, non executable file
-    std::cout << "emulator: error : file '" + file_name + "' is not executable" << std::endl;
-    exit(-1);
+    return fail("file '" + file_name + "' is not executable");
   }
 
-  for ( int i = 0; i < file.getNumberOfSegments(); i++) {
-    Elf32_Phdr* header = file.getSegmentHeader(i);
-    std::vector<uint8_t>& contents_ref = *file.getSegmentContents(i);
+  // Symbols are needed only by profilers, whole file is read for them
+  if ( profiling || sampling || call_graph ) {
+    Elf32File file(file_name, 0, true);
+    file.readFromFile();
+    profiler.loadSymbols(file);
+  }
 
-    uint32_t base_addr = header->p_vaddr;
+  cpu.gpr[PC] = START_ADDR;
+  memory.writeMMReg(TIM_CFG, 0);
+  timer_config = 0;
+  return true;
+}
 
-    for ( int j = 0; j < contents_ref.size(); j++) {
-      memory.write(base_addr + j, contents_ref[j]);
-    }
+bool Emulator::loadSnapshot() {
+  SnapshotHeader header;
+  std::string input;
+
+  if ( !snapshot.load(load_snapshot, header, input, memory) ) {
+    return fail("file '" + load_snapshot + "' is not a valid snapshot");
   }
 
+  restoreState(header);
+  terminal.addInput(input);
+  return true;
 }
 
-void Emulator::setUpTerminal() {
-  termios new_attr;
+bool Emulator::saveSnapshot() {
+  SnapshotHeader header = {};
+  captureState(header);
 
-  // Save old attributes so we can restore them at the end
-  tcgetattr(STDIN_FILENO, &old_attr);
-  tcgetattr(STDIN_FILENO, &new_attr);
+  if ( !Snapshot::save(save_snapshot, header, terminal.takeInput(), memory) ) {
+    return fail("could not write snapshot '" + save_snapshot + "'");
+  }
+  return true;
+}
 
-  // Disable echo and canonical mode(so it doesn't wait for line-delimeter char)
-  new_attr.c_lflag &= ~(ECHO | ICANON);
+void Emulator::exitWithError() {
+  restoreTerminal();
+  std::cout << "emulator: error : " + error << std::endl;
+  exit(-1);
+}
 
-  tcsetattr(STDIN_FILENO, TCSAFLUSH, &new_attr);
+void Emulator::captureState(SnapshotHeader& state) {
+  std::copy(cpu.gpr, cpu.gpr + GPR_CNT, state.gpr);
+  std::copy(cpu.csr, cpu.csr + CSR_CNT, state.csr);
+  state.pending = cpu.pending.load(std::memory_order_relaxed);
+  state.last_i = cpu.lastI;
+  state.retired = retired;
+  state.timer_started = timer_started;
+  state.timer_left = timer_deadline == NO_DEADLINE ? NO_DEADLINE : timer_deadline - retired;
+  state.timer_ticks = timer_ticks;
+}
 
-  // Make it so read instruction is non blocking
-  old_flags = fcntl(STDIN_FILENO, F_GETFL);
-  fcntl(STDIN_FILENO, F_SETFL, old_flags | O_NONBLOCK);
+void Emulator::restoreState(const SnapshotHeader& state) {
+  std::copy(state.gpr, state.gpr + GPR_CNT, cpu.gpr);
+  std::copy(state.csr, state.csr + CSR_CNT, cpu.csr);
+  cpu.pending.store(state.pending, std::memory_order_relaxed);
+  cpu.lastI = state.last_i;
+  retired = state.retired;
+  timer_ticks = state.timer_ticks;
+  timer_config = memory.readMMReg(TIM_CFG);
+  next_input = retired + input_interval;
+  terminal_handling = false;
+  idle_state = IDLE_OFF;
+
+  // Virtual timer can be stopped again, timer thread keeps running once started
+  if ( virtual_timer ) {
+    timer_started = false;
+    timer_deadline = NO_DEADLINE;
+  }
+  // State taken with the real timer has no deadline, next tick is a whole period away
+  if ( state.timer_started && !timer_started ) startTimer();
+  if ( virtual_timer && state.timer_left != NO_DEADLINE ) timer_deadline = retired + state.timer_left;
+}
+
+bool Emulator::setUpTerminal() {
+  if ( headless ) terminal.setHeadless();
+
+  if ( input_file != "" && !terminal.openInput(input_file) ) {
+    return fail("could not read input file '" + input_file + "'");
+  }
+
+  if ( output_file != "" && !terminal.openOutput(output_file) ) {
+    return fail("could not open output file '" + output_file + "'");
+  }
+
+  if ( input_interval_ms ) input_interval *= timer_rate;
+  next_input = retired + input_interval;
+
+  terminal.start();
+  return true;
 }
 
 
 void Emulator::restoreTerminal() {
-  tcsetattr(STDIN_FILENO, TCSAFLUSH, &old_attr);
-  //fcntl(STDIN_FILENO, old_flags);
+  terminal.stop();
 }
 
 void Emulator::startTimer() {
-  timer_thread = new std::thread(Emulator::timerBody, std::ref(this->memory), std::ref(this->cpu));
+  timer_started = true;
+  if ( virtual_timer ) {
+    timer_deadline = retired + timerPeriod();
+  } else {
+    timer_running = true;
+    timer_thread = new std::thread(&Emulator::timerBody, this);
+  }
 }
 
-void Emulator::timerBody(Memory& memory, CPU& cpu) {
+void Emulator::stopTimer() {
+  if ( !timer_thread ) return;
+
+  {
+    std::lock_guard<std::mutex> lock(timer_mutex);
+    timer_running = false;
+  }
+  timer_cv.notify_one();
+  timer_thread->join();
+  delete timer_thread;
+  timer_thread = nullptr;
+}
+
+uint64_t Emulator::timerPeriod() {
+  return (uint64_t)timer_periods[timer_config.load(std::memory_order_relaxed) & 0x7] * timer_rate;
+}
+
+void Emulator::timerExpired() {
+  cpu.setInterruptRequest(TIM);
+  timer_ticks++;
+  // Period is read again, same as the timer thread does after every tick
+  timer_deadline = retired + timerPeriod();
+}
+
+// First jump after arming takes a snapshot, the next jump to the same address compares the state with it
+void Emulator::checkIdle(uint32_t target) {
+  if ( idle_state == IDLE_ARMED ) {
+    idle_state = IDLE_WATCHING;
+    idle_pc = target;
+    idle_changes = state_changes;
+    std::copy(cpu.gpr, cpu.gpr + GPR_CNT, idle_gpr);
+    std::copy(cpu.csr, cpu.csr + CSR_CNT, idle_csr);
+    return;
+  }
+
+  if ( target != idle_pc ) return;
+
+  idle_state = IDLE_OFF;
+  if ( idle_changes == state_changes && std::equal(cpu.gpr, cpu.gpr + GPR_CNT, idle_gpr)
+    && std::equal(cpu.csr, cpu.csr + CSR_CNT, idle_csr) ) {
+    waitForEvent();
+  }
+}
+
+void Emulator::waitForEvent() {
+  idle_waits++;
+
+  if ( skipToEvent(false) ) return;
+
+  // Otherwise host thread sleeps until timer thread raises a request or terminal input arrives
+  // Device thread doesn't signal, input is noticed within TERMINAL_FLUSH_MS
+  std::unique_lock<std::mutex> lock(idle_mutex);
+  while ( !cpu.interruptPending() && !(terminal.hasInput() && terminalReady()) ) {
+    idle_cv.wait_for(lock, std::chrono::milliseconds(TERMINAL_FLUSH_MS));
+  }
+  lock.unlock();
+  handleTerminal();
+}
+
+// Wakes up on any interrupt request, even a masked one, so guest can check for work with interrupts disabled
+void Emulator::waitForInterrupt() {
+  if ( cpu.hasInterruptRequests() ) return;
+  wfi_waits++;
+  if ( skipToEvent(true) ) return;
+
+  // Nothing could ever wake the processor up, wfi is executed as a no-op instead of hanging the emulator
+  bool real_timer = timer_started && !virtual_timer;
+  if ( !real_timer && headless && !terminal.hasInput() ) return;
+
+  std::unique_lock<std::mutex> lock(idle_mutex);
+  while ( !cpu.hasInterruptRequests() && !(terminal.hasInput() && terminalReady()) ) {
+    idle_cv.wait_for(lock, std::chrono::milliseconds(TERMINAL_FLUSH_MS));
+  }
+  lock.unlock();
+  handleTerminal();
+}
+
+// Events scheduled in instructions(including the end of a limited run) can be reached right away, returns false
+// if there is none
+// Masked timer still raises its request, which is enough when waiting for any request
+// With the real timer running, end of a limited run isn't the next event, the timer thread could come first
+bool Emulator::skipToEvent(bool masked) {
+  uint64_t next = NO_DEADLINE;
+  if ( virtual_timer && (masked || (!cpu.getIF() && !cpu.getTrF())) ) next = timer_deadline;
+  if ( headless && terminal.hasInput() && terminalReady() ) next = std::min(next, std::max(next_input, retired));
+  if ( !timer_started || virtual_timer ) next = std::min(next, run_limit);
+
+  if ( next == NO_DEADLINE ) return false;
+
+  if ( next > retired ) {
+    skipped += next - retired;
+    retired = next;
+  }
+  if ( retired >= timer_deadline ) timerExpired();
+  handleTerminal();
+  return true;
+}
+
+void Emulator::timerBody() {
   uint32_t current_period;
-  Emulator* emulator = Emulator::getInstance();
+  std::unique_lock<std::mutex> lock(timer_mutex);
 
   while(true) { 
-    current_period = timer_periods[memory.readMMReg(TIM_CFG)];
+    current_period = timer_periods[timer_config.load(std::memory_order_relaxed) & 0x7];
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(current_period));
+    if ( timer_cv.wait_for(lock, std::chrono::milliseconds(current_period), [this] { return !timer_running; }) ) break;
 
-    if ( !Emulator::getInstance()->getCpuOn() ) break;
-    cpu.IR[TIM] = true;
+    cpu.setInterruptRequest(TIM);
+    wakeUp();
   }
 
 }
 
+void Emulator::startSampler() {
+  sampler_running = true;
+  sampler_thread = new std::thread(&Emulator::samplerBody, this);
+}
+
+void Emulator::stopSampler() {
+  if ( !sampler_thread ) return;
+
+  {
+    std::lock_guard<std::mutex> lock(sampler_mutex);
+    sampler_running = false;
+  }
+  sampler_cv.notify_one();
+  sampler_thread->join();
+  delete sampler_thread;
+  sampler_thread = nullptr;
+}
+
+void Emulator::samplerBody() {
+  std::unique_lock<std::mutex> lock(sampler_mutex);
+
+  while ( !sampler_cv.wait_for(lock, std::chrono::microseconds(sample_interval), [this] { return !sampler_running; }) ) {
+    sample_requested.store(true, std::memory_order_relaxed);
+  }
+}
+
+// Guest code has no frame pointers, so the call stack is recovered by scanning the top of the guest stack for
+// words that point right after a call instruction
+void Emulator::takeSample() {
+  sample_requested.store(false, std::memory_order_relaxed);
+
+  uint32_t frames[SAMPLE_DEPTH];
+  uint32_t depth = 0;
+  uint32_t sp = cpu.gpr[SP];
+  for ( uint32_t i = 0; i < SAMPLE_SCAN && depth < SAMPLE_DEPTH; i++ ) {
+    uint32_t address = sp + i * 4;
+    // Stack ends below memory mapped registers
+    if ( address < sp || address >= MM_REGS_BASE ) break;
+    uint32_t word = memory.readWord(address);
+    if ( word < 4 || word >= MM_REGS_BASE ) continue;
+    uint8_t oc_mod = extractOcMod(memory.readWord(word - 4));
+    if ( oc_mod == 0x20 || oc_mod == 0x21 ) frames[depth++] = word;
+  }
+
+  profiler.addSample(cpu.gpr[PC], frames, depth);
+}
+
 void Emulator::startEmulating() {
-  loadMemory();
-  setUpTerminal();
-  runCPU();
+  if ( !(load_snapshot != "" ? loadSnapshot() : loadMemory()) ) exitWithError();
+  // Native code marks dirty pages only if tracking was on when it was set up
+  if ( fuzz_dir != "" ) memory.trackDirtyPages();
+  // Block engines account for whole blocks, so they can't count single instructions
+  if ( instrumented && (engine == ENGINE_BLOCK || engine == ENGINE_JIT) ) engine = ENGINE_THREADED;
+  if ( sampling ) startSampler();
+  if ( tracing && !trace.open(trace_file) ) {
+    std::cout << "emulator: error : could not create trace file '" + trace_file + "'" << std::endl;
+    exit(-1);
+  }
+  if ( !run() && error != "" ) exitWithError();
+  if ( save_snapshot != "" && !saveSnapshot() ) exitWithError();
+  if ( fuzz_dir != "" ) runFuzz();
+  stopSampler();
+  if ( tracing ) trace.finish(cpu.gpr);
+  if ( profiling && !profiler.writeReport(profile_file) ) {
+    restoreTerminal();
+    std::cout << "emulator: error : could not write profile to '" + profile_file + "'" << std::endl;
+    exit(-1);
+  }
+  if ( call_graph && !calls.writeCallgrind(call_graph_file, profiler) ) {
+    restoreTerminal();
+    std::cout << "emulator: error : could not write call graph to '" + call_graph_file + "'" << std::endl;
+    exit(-1);
+  }
+  if ( sampling && !profiler.writeFolded(sample_file) ) {
+    restoreTerminal();
+    std::cout << "emulator: error : could not write samples to '" + sample_file + "'" << std::endl;
+    exit(-1);
+  }
+  if ( stats_file != "" ) {
+    std::ofstream fout(stats_file);
+    getCounters().writeJson(fout);
+    fout << std::endl;
+    if ( !fout ) {
+      restoreTerminal();
+      std::cout << "emulator: error : could not write counters to '" + stats_file + "'" << std::endl;
+      exit(-1);
+    }
+  }
   printCPUState();
   restoreTerminal();
+  stopTimer();
 }
 
 
@@ -102,231 +359,397 @@ void Emulator::printCPUState() {
     else std::cout << '\n';
   }
 
+  if ( virtual_timer ) {
+    std::cout << "Virtual timer: " << retired << " instructions retired, " << timer_ticks << " ticks\n";
+  }
+  if ( idle_waits ) {
+    std::cout << "Idle loops: " << idle_waits << " waits, " << skipped << " instructions skipped\n";
+  }
+  if ( fuzz_dir != "" ) {
+    std::cout << "Fuzzing: " << fuzz_runs << " inputs, " << fuzz_limits << " stopped at the limit, " << fuzz_invalid << " executed invalid instructions\n";
+  }
+  if ( wfi_waits ) {
+    std::cout << "Wait for interrupt: " << wfi_waits << " waits\n";
+  }
+  if ( profiling ) {
+    std::cout << "Profile: written to '" << profile_file << "'\n";
+  }
+  if ( tracing ) {
+    std::cout << "Trace: " << trace.getRecords() << " instructions, " << trace.getRawBytes() << " bytes compressed to "
+              << trace.getWrittenBytes() << " bytes in '" << trace_file << "'\n";
+  }
+  if ( call_graph ) {
+    std::cout << "Call graph: written to '" << call_graph_file << "'\n";
+  }
+  if ( sampling ) {
+    std::cout << "Sampling profile: " << profiler.getSampleCount() << " samples written to '" << sample_file << "'\n";
+  }
+  if ( host_calls ) {
+    std::cout << "Host calls: " << host_calls << "\n";
+  }
+  if ( engine == ENGINE_BLOCK || engine == ENGINE_JIT ) {
+    std::cout << "Block cache: " << block_cache.getTranslated() << " blocks translated, " << block_cache.getFlushes() << " flushes\n";
+    if ( idiom_runs ) {
+      std::cout << "Loop idioms: " << idiom_runs << " runs, " << idiom_iterations << " iterations\n";
+    }
+    if ( engine == ENGINE_JIT ) {
+      std::cout << "JIT: " << jit.getCompiled() << " blocks compiled, " << jit.getRejected() << " rejected\n";
+    }
+    if ( !AotRuntime::empty() ) {
+      std::cout << "AOT: " << AotRuntime::getRegistered() << " blocks translated ahead of time, " << AotRuntime::getAttached() << " attached\n";
+    }
+  } else {
+    std::cout << "Decode cache: " << decode_cache.getHits() << " hits, " << decode_cache.getMisses() << " misses\n";
+  }
+
+  getCounters().print(std::cout);
+
   std::cout << std::endl;
 }
 
+PerfCounters Emulator::getCounters() const {
+  PerfCounters current = counters;
+  block_cache.countOps(current.ops);
+  current.retired = retired;
+  current.skipped = skipped;
+  current.host_seconds = host_seconds;
+  if ( in_run ) current.host_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+  return current;
+}
+
+void Emulator::requestStats(int) {
+  stats_requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Emulator::installStatsSignal() {
+  signal(SIGUSR1, requestStats);
+}
+
+// Written on the emulation thread, so counters don't change while they are read
+void Emulator::dumpCounters() {
+  stats_seen = stats_requests.load(std::memory_order_relaxed);
+  getCounters().writeJson(std::cerr);
+  std::cerr << std::endl;
+}
+
+void Emulator::storeWord(uint32_t address, uint32_t word) {
+  if ( journaling ) store_journal.push_back(std::make_pair(address, memory.readWord(address)));
+  state_changes++;
+  memory.writeWord(address, word);
+  decode_cache.invalidate(address);
+  if ( block_cache.isCode(address) ) code_written = true;
+  if ( address >= DEVICE_BASE ) deviceWrite(address, word);
+}
+
+// Writes emulator does on guest's behalf, decoded instructions and translations are dropped as they are for stores
+void Emulator::rangeWritten(uint32_t address, uint32_t size) {
+  if ( !size ) return;
+  state_changes++;
+  for ( uint32_t page = address >> PAGE_BITS; page <= (address + size - 1) >> PAGE_BITS; page++ ) {
+    decode_cache.invalidatePage(page << PAGE_BITS);
+    if ( block_cache.getCodeMap()[page] ) code_written = true;
+  }
+}
+
+uint32_t Emulator::deviceRead(uint32_t address) {
+  counters.mmio_reads++;
+  const Device* device = devices.find(address);
+  if ( device && device->read ) {
+    // Value can be different on every read, so a loop polling the device isn't idle
+    state_changes++;
+    return device->read(device->context, address - device->base);
+  }
+  return memory.readWord(address);
+}
+
+void Emulator::deviceWrite(uint32_t address, uint32_t word) {
+  counters.mmio_writes++;
+  const Device* device = devices.find(address);
+  if ( device && device->write ) device->write(device->context, address - device->base, word);
+}
+
+void Emulator::terminalWrite(void* context, uint32_t offset, uint32_t word) {
+  Emulator* emulator = (Emulator*)context;
+  // Output was already written when a JIT block being replayed was interpreted
+  if ( offset == TERM_OUT * 4 && !emulator->replaying ) emulator->terminal.output(word);
+}
+
+void Emulator::timerWrite(void* context, uint32_t offset, uint32_t word) {
+  Emulator* emulator = (Emulator*)context;
+  // Timer device starts at tim_cfg, stores which only partly overlap it don't change the configuration
+  if ( offset == 0 ) emulator->timer_config.store(word, std::memory_order_relaxed);
+}
+
 void Emulator::pushWord(uint32_t val) {
   cpu.gpr[SP] -= 4;
-  memory.writeWord(cpu.gpr[SP], val);
+  storeWord(cpu.gpr[SP], val);
 }
 
 uint32_t Emulator::popWord() {
-  uint32_t val = memory.readWord(cpu.gpr[SP]);
+  uint32_t val = loadWord(cpu.gpr[SP]);
   cpu.gpr[SP] -= 4;
   return val;
 }
 
 void Emulator::handleInterrupt(uint8_t cause) {
+  if ( cause == INV ) invalid_instructions++;
+  counters.interrupts[cause]++;
   cpu.csr[CAUSE] = cause + 1;
   cpu.clearInterruptRequest(cause);
+  if ( cause == TERM ) terminal_handling = true;
 
   pushWord(cpu.csr[STATUS]);
   pushWord(cpu.gpr[PC]);
 
   cpu.maskInterrupts();
 
+  if ( call_graph ) calls.interrupted(cpu.gpr[PC], cpu.csr[HANDLER]);
+  if ( tracing ) trace.interrupted(cause);
   cpu.gpr[PC] = cpu.csr[HANDLER];
 }
 
 void Emulator::handleTerminal() {
-  
-  // Write character to console if term_in register was written into
-  if ( out_flag ) {
-    out_flag = false;
 
-    char out_c = memory.readMMReg(TERM_OUT);
-    write(STDOUT_FILENO, &out_c, 1);
-  }
+  // Take a character that device thread has read, write it to term_in and set terminal interrupt request bit(once
+  // the handler address has been set). Scripted input also waits for its scheduled time
 
-  // Try to read a character from terminal
-  // If successfull, write it to term_in and set terminal interrupt request bit
+  if ( !cpu.getIF() ) terminal_handling = false;
 
-  char in_c;
-  if ( read(STDIN_FILENO, &in_c, 1) > 0 ) {
+  uint8_t in_c;
+  if ( retired >= next_input && terminalReady() && terminal.readInput(in_c) ) {
     memory.writeMMReg(TERM_IN, in_c);
-    cpu.IR[TERM] = true;
+    if ( cpu.csr[HANDLER] != 0 ) cpu.setInterruptRequest(TERM);
+    next_input = retired + input_interval;
+    state_changes++;
   }
 
 }
 
-void Emulator::runCPU() {
-  bool running = true;
+// True if guest can take the next character, apart from its scheduled time
+// Guest that takes terminal interrupts gets the next character only once the request for the previous one was
+// accepted and its handler returned, so none are overwritten before the handler reads them. Without a handler, or
+// with TL masked, guest polls term_in, so characters are written as they come
+bool Emulator::terminalReady() const {
+  if ( cpu.csr[HANDLER] == 0 || cpu.getTlF() ) return true;
+  return !cpu.hasInterruptRequest(TERM) && !(terminal_handling && cpu.getIF());
+}
 
-  cpu_on = true;
-  cpu.gpr[PC] = START_ADDR;
-  memory.writeMMReg(TIM_CFG, 0);
+void Emulator::checkInterrupts() {
+  int cause = cpu.acceptedInterrupt();
+  if ( cause >= 0 ) handleInterrupt(cause);
+}
+
+bool Emulator::run(uint64_t instructions) {
+  if ( !started ) {
+    if ( !setUpTerminal() ) return false;
+    started = true;
+    if ( engine == ENGINE_JIT ) setUpJit();
+  }
+
+  halted = false;
+  run_limit = instructions == NO_DEADLINE ? NO_DEADLINE : retired + instructions;
+  // Profilers and the trace have to see both instructions of a pair
+  decode_cache.setFusePairs(engine == ENGINE_THREADED && !instrumented);
+  run_start = std::chrono::steady_clock::now();
+  in_run = true;
+  runEngine();
+  in_run = false;
+  host_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+  run_limit = NO_DEADLINE;
+
+  // Guest output has to be on the console before processor state
+  terminal.flush();
+  return halted;
+}
+
+// Runs until halt, or until run_limit instructions have retired
+void Emulator::runEngine() {
+  if ( retired >= run_limit ) return;
+  switch (engine) {
+    case ENGINE_THREADED: runThreaded(); break;
+    case ENGINE_BLOCK: case ENGINE_JIT: runBlocks(); break;
+    default: runSwitch(); break;
+  }
+}
+
+void Emulator::runSwitch() {
+  bool running = true;
+  bool waiting = false;
 
   while(running) {
     
-    uint32_t instr = fetchInstruction();
-    uint8_t oc_mod = extractOcMod(instr);
-    uint8_t reg_A = extractRegA(instr);
-    uint8_t reg_B = extractRegB(instr);
-    uint8_t reg_C = extractRegC(instr);
-    uint32_t disp = extractDisplacement(instr);
-
-    switch (oc_mod) {
-      case 0x00: {    // halt
+    uint32_t pc = cpu.gpr[PC];
+    pollRequests();
+    // Fields are copied, because the instruction can overwrite itself and invalidate its cache entry
+    const DecodedInstr& decoded = fetchInstruction();
+    counters.ops[decoded.op]++;
+    if ( instrumented ) instrument(pc, decoded);
+    uint8_t reg_A = decoded.reg_A;
+    uint8_t reg_B = decoded.reg_B;
+    uint8_t reg_C = decoded.reg_C;
+    uint32_t disp = decoded.disp;
+
+    switch (decoded.op) {
+      case OP_HALT: {    // halt
         running = false;
+        halted = true;
         break;
       }
-      case 0x10: {    // int
+      case OP_INT: {    // int
         cpu.setInterruptRequest(INT);
         break;
       }
-      case 0x20: {    // call instructions
+      case OP_WFI: {    // wfi
+        // Processor sleeps once wfi has been counted, so a skip to the end of a limited run stops right there
+        waiting = true;
+        break;
+      }
+      case OP_CALL: {    // call instructions
         pushWord(cpu.gpr[PC]);
         cpu.gpr[PC] = cpu.gpr[reg_A] + cpu.gpr[reg_B] + disp;
         break;  
       }
-      case 0x21: {    
+      case OP_CALL_MEM: {    
         pushWord(cpu.gpr[PC]);
-        cpu.gpr[PC] = memory.readWord(cpu.gpr[reg_A] + cpu.gpr[reg_B] + disp);
+        cpu.gpr[PC] = loadWord(cpu.gpr[reg_A] + cpu.gpr[reg_B] + disp);
         break;  
       }
-      case 0x30: {    // jump instructions
+      case OP_JMP: {    // jump instructions
         cpu.gpr[PC] = cpu.gpr[reg_A] + disp;
         break;
       }
-      case 0x31: {   
+      case OP_BEQ: {   
         if ( cpu.gpr[reg_B] == cpu.gpr[reg_C] ) cpu.gpr[PC] = cpu.gpr[reg_A] + disp;
         break;
       }
-      case 0x32: {    
+      case OP_BNE: {    
         if ( cpu.gpr[reg_B] != cpu.gpr[reg_C] ) cpu.gpr[PC] = cpu.gpr[reg_A] + disp;
         break;
       }
-      case 0x33: {   
+      case OP_BGT: {   
         if ( (int32_t)cpu.gpr[reg_B] > (int32_t)cpu.gpr[reg_C] ) cpu.gpr[PC] = cpu.gpr[reg_A] + disp;
         break;
       }
-      case 0x38: {    
-        cpu.gpr[PC] = memory.readWord(cpu.gpr[reg_A] + disp);
+      case OP_JMP_MEM: {    
+        cpu.gpr[PC] = loadWord(cpu.gpr[reg_A] + disp);
         break;
       }
-      case 0x39: {   
+      case OP_BEQ_MEM: {   
         if ( cpu.gpr[reg_B] == cpu.gpr[reg_C] ) memory.readWord(cpu.gpr[PC] = cpu.gpr[reg_A] + disp);
         break;
       }
-      case 0x3a: {    
+      case OP_BNE_MEM: {    
         if ( cpu.gpr[reg_B] != cpu.gpr[reg_C] ) memory.readWord(cpu.gpr[PC] = cpu.gpr[reg_A] + disp);
         break;
       }
-      case 0x3b: {   
+      case OP_BGT_MEM: {   
         if ( (int32_t)cpu.gpr[reg_B] > (int32_t)cpu.gpr[reg_C] ) memory.readWord(cpu.gpr[PC] = cpu.gpr[reg_A] + disp);
         break;
       }
-      case 0x40: {  // xchng
+      case OP_XCHG: {  // xchng
         uint32_t temp = cpu.gpr[reg_B];
         cpu.gpr[reg_B] = cpu.gpr[reg_C];
         cpu.gpr[reg_C] = temp;
         break;
       }
-      case 0x50: {  // arithmetic instruction
+      case OP_ADD: {  // arithmetic instruction
         cpu.gpr[reg_A] = (int32_t)cpu.gpr[reg_B] + (int32_t)cpu.gpr[reg_C];
         break;
       }
-      case 0x51: { 
+      case OP_SUB: { 
         cpu.gpr[reg_A] = (int32_t)cpu.gpr[reg_B] - (int32_t)cpu.gpr[reg_C];
         break;
       }
-      case 0x52: { 
+      case OP_MUL: { 
         cpu.gpr[reg_A] = (int32_t)cpu.gpr[reg_B] * (int32_t)cpu.gpr[reg_C];
         break;
       }
-      case 0x53: { 
+      case OP_DIV: { 
         cpu.gpr[reg_A] = (int32_t)cpu.gpr[reg_B] / (int32_t)cpu.gpr[reg_C];
         break;
       }
-      case 0x60: {  // logical instructions
+      case OP_NOT: {  // logical instructions
         cpu.gpr[reg_A] = ~cpu.gpr[reg_B];
         break;
       }
-      case 0x61: { 
+      case OP_AND: { 
         cpu.gpr[reg_A] = cpu.gpr[reg_B] & cpu.gpr[reg_C];
         break;
       }
-      case 0x62: { 
+      case OP_OR: { 
         cpu.gpr[reg_A] = cpu.gpr[reg_B] | cpu.gpr[reg_C];
         break;
       }
-      case 0x63: { 
+      case OP_XOR: { 
         cpu.gpr[reg_A] = cpu.gpr[reg_B] ^ cpu.gpr[reg_C];
         break;
       }
-      case 0x70: {  // shift instructions
+      case OP_SHL: {  // shift instructions
         cpu.gpr[reg_A] = cpu.gpr[reg_B] << cpu.gpr[reg_C];
         break;
       }
-      case 0x71: {
+      case OP_SHR: {
         cpu.gpr[reg_A] = cpu.gpr[reg_B] >> cpu.gpr[reg_C];
         break;
       }
-      case 0x80: {  // store instructions
+      case OP_ST: {  // store instructions
         uint32_t addr = cpu.gpr[reg_A] + cpu.gpr[reg_B] + disp;
-        memory.writeWord(addr, cpu.gpr[reg_C]);
-        if ( addr == MM_REGS_BASE + TERM_OUT ) out_flag = true;
+        storeWord(addr, cpu.gpr[reg_C]);
         break;
       }
-      case 0x82: {  
-        uint32_t addr = memory.readWord(cpu.gpr[reg_A] + cpu.gpr[reg_B] + disp);
-        memory.writeWord(addr, cpu.gpr[reg_C]);
-        if ( addr == MM_REGS_BASE + TERM_OUT ) out_flag = true;
+      case OP_ST_MEM: {  
+        uint32_t addr = loadWord(cpu.gpr[reg_A] + cpu.gpr[reg_B] + disp);
+        storeWord(addr, cpu.gpr[reg_C]);
         break;
       }
-      case 0x81: {
+      case OP_ST_PUSH: {
         cpu.gpr[reg_A] += disp;
         uint32_t addr = cpu.gpr[reg_A];
-        memory.writeWord(addr, cpu.gpr[reg_C]);
-        if ( addr == MM_REGS_BASE + TERM_OUT ) out_flag = true;
+        storeWord(addr, cpu.gpr[reg_C]);
         break;
       }     
-      case 0x90: {  // load instructions
+      case OP_CSRRD: {  // load instructions
         cpu.gpr[reg_A] = cpu.csr[reg_B];
         break;
       }
-      case 0x91: {
+      case OP_LD_REG: {
         cpu.gpr[reg_A] = cpu.gpr[reg_B] + disp;
         break;
       }
-      case 0x92: {
-        cpu.gpr[reg_A] = memory.readWord(cpu.gpr[reg_B] + cpu.gpr[reg_C] + disp);
+      case OP_LD_MEM: {
+        cpu.gpr[reg_A] = loadWord(cpu.gpr[reg_B] + cpu.gpr[reg_C] + disp);
         break;
       }
-      case 0x93: {
-        uint32_t old_pc = cpu.gpr[PC];  // if IRET next operation will change PC, so we need to save it
-        cpu.gpr[reg_A] = memory.readWord(cpu.gpr[reg_B]);
+      case OP_LD_POP: {
+        cpu.gpr[reg_A] = loadWord(cpu.gpr[reg_B]);
         cpu.gpr[reg_B] += disp;
-        // We have to check if this instruction is part of IRET 
-        if ( instr == 0x93FE0004 ) {
-          // We feth instruction that should have came after this instruction(before pc was changed)
-          uint32_t next_instr = memory.readWord(old_pc);
-          if ( next_instr == 0x970E0004 ) {
-            // It is part of IRET, so we have to execute this instruction as well, since IRET has to be executed as an atomic instruction
-            cpu.csr[extractRegA(next_instr)] = memory.readWord(cpu.gpr[extractRegB(next_instr)]);
-            cpu.gpr[extractRegB(next_instr)] += extractDisplacement(next_instr);
-          }
-        }
-        break;
-      }
-      case 0x94: {  
+        break;
+      }
+      case OP_IRET: {   // pop pc and pop status, decoded as one instruction since IRET has to be executed atomically
+        cpu.gpr[PC] = loadWord(cpu.gpr[SP]);
+        cpu.gpr[SP] += 4;
+        cpu.csr[STATUS] = loadWord(cpu.gpr[SP]);
+        cpu.gpr[SP] += 4;
+        break;
+      }
+      case OP_CSRWR: {  
         cpu.csr[reg_A] = cpu.gpr[reg_B];
         break;
       }
-      case 0x95: {  
+      case OP_CSR_OR: {  
         cpu.csr[reg_A] = cpu.csr[reg_B] | disp;
         break;
       }
-      case 0x96: {  
-        cpu.csr[reg_A] = memory.readWord(cpu.gpr[reg_B] + cpu.gpr[reg_C] + disp);
+      case OP_CSR_LD_MEM: {  
+        cpu.csr[reg_A] = loadWord(cpu.gpr[reg_B] + cpu.gpr[reg_C] + disp);
         break;
       }
-      case 0x97: {
-        cpu.csr[reg_A] = memory.readWord(cpu.gpr[reg_B]);
+      case OP_CSR_POP: {
+        cpu.csr[reg_A] = loadWord(cpu.gpr[reg_B]);
         cpu.gpr[reg_B] += disp;
         break;
       }
-      default: {
+      case OP_INVALID: default: {
         cpu.setInterruptRequest(INV); // Invalid instruction
       }
     }
@@ -342,24 +765,24 @@ void Emulator::runCPU() {
 
 
     // Start timer only after handler address has been set
-    if ( !timer_thread && cpu.csr[HANDLER] != 0 ) {
+    if ( !timer_started && cpu.csr[HANDLER] != 0 ) {
       startTimer();
     }
 
-    handleTerminal();
-
-    if ( cpu.IR[INT] ) {
-      handleInterrupt(INT);
-    } else if ( cpu.IR[INV] ) {
-      handleInterrupt(INV);
-    } else if ( cpu.IR[TERM] && !(cpu.csr[STATUS] & FLAG_I) && !(cpu.csr[STATUS] & FLAG_TL) ) {
-      handleInterrupt(TERM);
-    } else if ( cpu.IR[TIM] && !(cpu.csr[STATUS] & FLAG_I) && !(cpu.csr[STATUS] & FLAG_TR) ) {
-      handleInterrupt(TIM);
+    advanceTime(1);
+    if ( waiting ) {
+      waitForInterrupt();
+      waiting = false;
     }
+    if ( (retired & (TERMINAL_POLL_INTERVAL - 1)) == 0 ) armIdle();
+    if ( idle_state && cpu.gpr[PC] != pc + 4 ) checkIdle(cpu.gpr[PC]);
+    // Waits and idle checks can skip ahead to the end of the run
+    if ( retired >= run_limit ) running = false;
+
+    handleTerminal();
 
+    checkInterrupts();
 
   }
 
-  cpu_on = false;
 }
\ No newline at end of file
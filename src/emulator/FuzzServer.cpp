@@ -0,0 +1,70 @@
+#include "../../inc/emulator/Emulator.hpp"
+
+#include <dirent.h>
+#include <algorithm>
+
+/*
+  Fork server mode
+  Boot code runs once, up to the first halt, and that state is the checkpoint. Every input file is then delivered
+  through the terminal to a run that starts from the checkpoint and lasts until the next halt or fuzz_limit
+  instructions. Memory tracks pages written by the run, so only those are copied back before the next input
+*/
+void Emulator::runFuzz() {
+  DIR* dir = opendir(fuzz_dir.c_str());
+  if ( !dir ) {
+    restoreTerminal();
+    std::cout << "emulator: error : could not open input directory '" + fuzz_dir + "'" << std::endl;
+    exit(-1);
+  }
+
+  std::vector<std::string> inputs;
+  while ( dirent* entry = readdir(dir) ) {
+    std::string name = entry->d_name;
+    if ( name != "." && name != ".." ) inputs.push_back(name);
+  }
+  closedir(dir);
+  std::sort(inputs.begin(), inputs.end());
+
+  SnapshotHeader checkpoint = {};
+  captureState(checkpoint);
+  memory.checkpoint();
+  terminal.startCapture();
+
+  for ( std::string& name : inputs ) {
+    terminal.setInput("");
+    if ( !terminal.openInput(fuzz_dir + "/" + name) ) continue;
+
+    invalid_instructions = 0;
+    bool stopped = !run(fuzz_limit);
+    const std::string& output = terminal.getCaptured();
+    fuzz_runs++;
+    if ( stopped ) fuzz_limits++;
+    if ( invalid_instructions ) fuzz_invalid++;
+
+    std::cout << "fuzz: " << name << ": " << (stopped ? "stopped at the limit" : "halted") << " after "
+              << retired - checkpoint.retired << " instructions, " << invalid_instructions << " invalid, "
+              << output.size() << " bytes of output(hash ";
+    Helper::printHex(std::cout, Helper::hashString(output), 10, true);
+    std::cout << ")\n";
+
+    resetToCheckpoint(checkpoint);
+  }
+
+}
+
+void Emulator::resetToCheckpoint(const SnapshotHeader& checkpoint) {
+  memory.restoreDirty([&](uint32_t address) {
+    decode_cache.invalidatePage(address);
+    if ( block_cache.isCode(address) ) code_written = true;
+  });
+
+  // Blocks from restored pages could have been changed by the run
+  if ( code_written ) {
+    block_cache.flush();
+    jit.reset();
+    code_written = false;
+  }
+
+  restoreState(checkpoint);
+  terminal.clearCaptured();
+}
@@ -0,0 +1,104 @@
+#include "../../inc/emulator/Emulator.hpp"
+
+#include <fstream>
+#include <climits>
+#include <stdlib.h>
+
+// Range has to be plain memory, calls don't go through device callbacks
+static bool hostRange(uint32_t address, uint32_t size) {
+  return (uint64_t)address + size <= DEVICE_BASE;
+}
+
+// Guest names files relative to the host directory, absolute paths and .. components are rejected, and the resolved
+// path has to stay inside the directory(a symbolic link could lead out of it)
+static bool hostPath(const std::string& dir, const std::string& name, std::string& path) {
+  if ( name.empty() || name[0] == '/' ) return false;
+  size_t start = 0;
+  while ( start <= name.size() ) {
+    size_t end = name.find('/', start);
+    if ( end == std::string::npos ) end = name.size();
+    if ( name.compare(start, end - start, "..") == 0 ) return false;
+    start = end + 1;
+  }
+
+  char resolved_dir[PATH_MAX], resolved[PATH_MAX];
+  if ( !realpath(dir.c_str(), resolved_dir) ) return false;
+  if ( !realpath((dir + "/" + name).c_str(), resolved) ) return false;
+  std::string prefix = std::string(resolved_dir) + "/";
+  if ( std::string(resolved).compare(0, prefix.size(), prefix) != 0 ) return false;
+  path = resolved;
+  return true;
+}
+
+void Emulator::hostWrite(void* context, uint32_t offset, uint32_t word) {
+  Emulator* emulator = (Emulator*)context;
+  // Call was already done when a JIT block being replayed was interpreted
+  if ( offset != HOST_CALL * 4 || emulator->replaying ) return;
+
+  uint32_t result = emulator->hostCall(word);
+  emulator->memory.writeWord(HOST_REGS_BASE + HOST_RESULT * 4, result);
+}
+
+uint32_t Emulator::hostCall(uint32_t call) {
+  uint32_t arg0 = memory.readWord(HOST_REGS_BASE + HOST_ARG0 * 4);
+  uint32_t arg1 = memory.readWord(HOST_REGS_BASE + HOST_ARG1 * 4);
+  uint32_t arg2 = memory.readWord(HOST_REGS_BASE + HOST_ARG2 * 4);
+  host_calls++;
+
+  switch (call) {
+    case HOST_COPY:
+      if ( !hostRange(arg0, arg2) || !hostRange(arg1, arg2) ) return HOST_ERROR;
+      memory.moveBytes(arg0, arg1, arg2);
+      rangeWritten(arg0, arg2);
+      return 0;
+
+    case HOST_FILL:
+      if ( arg2 > (uint32_t)DEVICE_BASE / 4 || !hostRange(arg0, arg2 * 4) ) return HOST_ERROR;
+      memory.fillWords(arg0, arg1, arg2);
+      rangeWritten(arg0, arg2 * 4);
+      return 0;
+
+    case HOST_WRITE: {
+      if ( !hostRange(arg0, arg1) ) return HOST_ERROR;
+      // Written a page at a time, size comes from the guest
+      char buffer[PAGE_SIZE];
+      for ( uint32_t count = 0; count < arg1; ) {
+        uint32_t address = arg0 + count;
+        uint32_t chunk = std::min(arg1 - count, PAGE_SIZE - (address & PAGE_MASK));
+        memory.readBytes(address, (uint8_t*)buffer, chunk);
+        terminal.output(std::string(buffer, chunk));
+        count += chunk;
+      }
+      return arg1;
+    }
+
+    case HOST_READ_FILE: {
+      // Files can be read only from the directory given with -host-dir, and never while fuzzing
+      if ( host_dir == "" || fuzz_dir != "" ) return HOST_ERROR;
+      if ( !hostRange(arg1, arg2) ) return HOST_ERROR;
+      std::string name, path;
+      for ( uint32_t i = 0; ; i++ ) {
+        if ( i == HOST_PATH_MAX || !hostRange(arg0 + i, 1) ) return HOST_ERROR;
+        char c = memory.read(arg0 + i);
+        if ( c == '\0' ) break;
+        name.push_back(c);
+      }
+      if ( !hostPath(host_dir, name, path) ) return HOST_ERROR;
+
+      std::ifstream file(path, std::ios::binary);
+      if ( !file.is_open() ) return HOST_ERROR;
+      // Read a page at a time, size comes from the guest
+      uint32_t count = 0;
+      char buffer[PAGE_SIZE];
+      while ( count < arg2 && file.read(buffer, std::min(arg2 - count, PAGE_SIZE)).gcount() > 0 ) {
+        memory.writeBytes(arg1 + count, (const uint8_t*)buffer, file.gcount());
+        count += file.gcount();
+      }
+      rangeWritten(arg1, count);
+      return count;
+    }
+
+    default:
+      return HOST_ERROR;
+  }
+}
@@ -0,0 +1,109 @@
+#include "../../inc/emulator/Emulator.hpp"
+
+// Lowest address and size of the words accessed over count iterations, false if they aren't all plain memory
+static bool idiomRange(uint32_t first, uint32_t stride, uint64_t count, uint32_t& low, uint32_t& size) {
+  uint64_t span = (count - 1) * 4;
+  if ( stride == 4 ) {
+    if ( first + span + 4 > DEVICE_BASE ) return false;
+    low = first;
+  } else {
+    if ( first < span || first + 4ull > DEVICE_BASE ) return false;
+    low = first - span;
+  }
+  size = count * 4;
+  return true;
+}
+
+/*
+  Runs iterations of the loop at PC as one host operation, and returns the number of instructions that were executed,
+  or 0 if the loop has to be interpreted(addresses don't move by a word, or reach devices or translated code)
+  Loop is stopped where time has to be advanced, so the timer interrupt and the run limit come at an iteration
+  boundary, after which the engine polls and delivers interrupts as it does at any block end
+*/
+uint32_t Emulator::runIdiom(const LoopIdiom& idiom) {
+  uint32_t* gpr = cpu.gpr;
+
+  uint64_t left = (std::min(timer_deadline, run_limit) - retired) / idiom.size;
+  uint64_t count = idiom.iterations(gpr);
+  bool finished = count && count <= left && count <= IDIOM_MAX_ITERATIONS;
+  if ( !finished ) count = std::min(left, (uint64_t)IDIOM_MAX_ITERATIONS);
+  if ( count < 2 ) return 0;
+
+  const IdiomAccess& first = idiom.kind == IDIOM_FILL ? idiom.store : idiom.load[0];
+  uint32_t stride = idiom.addressStep(gpr, first);
+  if ( stride != 4 && stride != (uint32_t)-4 ) return 0;
+
+  uint32_t low[2], size;
+  uint32_t address[2];
+  const IdiomAccess* accesses[2] = { &first, idiom.kind == IDIOM_COPY ? &idiom.store : &idiom.load[1] };
+  int arrays = idiom.kind == IDIOM_FILL ? 1 : 2;
+  for ( int i = 0; i < arrays; i++ ) {
+    address[i] = idiom.address(gpr, *accesses[i]);
+    if ( idiom.addressStep(gpr, *accesses[i]) != stride ) return 0;
+    if ( !idiomRange(address[i], stride, count, low[i], size) ) return 0;
+  }
+
+  // Stores to pages with translated code have to leave the block, those are left to the interpreter
+  int written = idiom.kind == IDIOM_COPY ? 1 : idiom.kind == IDIOM_FILL ? 0 : -1;
+  if ( written >= 0 ) {
+    const uint8_t* code_map = block_cache.getCodeMap();
+    for ( uint32_t page = low[written] >> PAGE_BITS; page <= (low[written] + size - 1) >> PAGE_BITS; page++ ) {
+      if ( code_map[page] ) return 0;
+    }
+  }
+
+  uint64_t full = count;
+  bool partial = false;
+  uint32_t loaded[2] = {};
+  switch (idiom.kind) {
+    case IDIOM_COPY: {
+      // Every word has to be read before the loop overwrites it, as it is with memmove
+      uint32_t distance = stride == 4 ? address[1] - address[0] : address[0] - address[1];
+      if ( distance != 0 && distance < size ) return 0;
+      loaded[0] = memory.readWord(address[0] + (count - 1) * stride);
+      memory.moveBytes(low[1], low[0], size);
+      break;
+    }
+    case IDIOM_FILL:
+      memory.fillWords(low[0], gpr[idiom.ops[idiom.store.at].reg_C], count);
+      break;
+    case IDIOM_COMPARE: {
+      if ( stride != 4 ) return 0;
+      uint64_t last = count - 1;
+      uint32_t difference = memory.firstDifference(low[0], low[1], size);
+      if ( difference < size ) {
+        full = difference / 4;
+        partial = true;
+        last = full;
+      }
+      loaded[0] = memory.readWord(address[0] + last * 4);
+      loaded[1] = memory.readWord(address[1] + last * 4);
+      break;
+    }
+    default:
+      return 0;
+  }
+
+  if ( written >= 0 ) rangeWritten(low[written], size);
+
+  // Partial iteration ran up to and including the compare exit
+  uint32_t steps[GPR_CNT];
+  for ( int r = 0; r < GPR_CNT; r++ ) steps[r] = idiom.step(gpr, r);
+  for ( int r = 0; r < GPR_CNT; r++ ) {
+    gpr[r] += full * steps[r];
+    if ( partial && idiom.updated[r] < idiom.compare_exit ) gpr[r] += steps[r];
+  }
+  for ( int i = 0; i < idiom.loads; i++ ) gpr[idiom.ops[idiom.load[i].at].reg_A] = loaded[i];
+
+  const DecodedInstr& exit = idiom.ops[idiom.compare_exit];
+  if ( partial ) gpr[PC] = idiom.start + (idiom.compare_exit + 1) * 4 + exit.disp;
+  else if ( finished ) gpr[PC] = idiom.start + idiom.size * 4;
+
+  uint32_t executed = full * idiom.size + (partial ? idiom.compare_exit + 1 : 0);
+  for ( uint32_t i = 0; i < idiom.size; i++ ) {
+    counters.ops[idiom.ops[i].op] += full + (partial && i <= idiom.compare_exit);
+  }
+  idiom_runs++;
+  idiom_iterations += full + partial;
+  return executed;
+}
@@ -0,0 +1,452 @@
+#include "../../inc/emulator/JitCompiler.hpp"
+#include "../../inc/emulator/X86Emitter.hpp"
+#include "../../inc/emulator/DeviceBus.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+  Register usage in generated code
+    R15         - pointer to guest gpr array, csr array comes right after it
+    R14         - context passed to helpers
+    RAX, RCX, RDX, RSI, RDI - scratch
+    rest        - guest registers used in the block
+*/
+
+#define REG_GPR       R15
+#define REG_CONTEXT   R14
+
+#define MMIO_PAGE     (DEVICE_BASE & ~PAGE_MASK)
+
+static const int allocatable[] = { RBX, RBP, R12, R13, R8, R9, R10, R11 };
+static const int saved[] = { RBX, RBP, R12, R13, R14, R15 };
+
+static const int32_t csr_offset = offsetof(CPU, csr) - offsetof(CPU, gpr);
+
+// Emits code for one block
+class BlockCompiler {
+
+  X86Emitter& e;
+  const void* page_directory;
+  const uint8_t* code_map;
+  uint8_t* dirty_map;
+  JitReadHelper read_helper;
+  JitWriteHelper write_helper;
+
+  int host[GPR_CNT];
+  uint32_t allocated = 0;
+  std::vector<size_t> exits;
+  // Instructions of the block up to and including the one being compiled
+  uint32_t retired = 0;
+
+  static uint32_t usedRegisters(const DecodedInstr& d);
+
+  int32_t gprOffset(uint8_t reg) const { return reg * 4; }
+
+  // Reads guest register into a host register, PC always holds the address of the next instruction
+  void get(int dst, uint8_t reg, uint32_t next_pc) {
+    if ( reg == PC ) e.movImm(dst, next_pc);
+    else e.mov(dst, host[reg]);
+  }
+
+  void spill() {
+    for ( int i = 0; i < GPR_CNT; i++ ) {
+      if ( allocated & (1 << i) ) e.store(REG_GPR, gprOffset(i), host[i]);
+    }
+  }
+
+  void reload() {
+    for ( int i = 0; i < GPR_CNT; i++ ) {
+      if ( allocated & (1 << i) ) e.load(host[i], REG_GPR, gprOffset(i));
+    }
+  }
+
+  void exitWith(uint32_t status) {
+    spill();
+    e.movImm(RAX, status);
+    exits.push_back(e.jmp());
+  }
+
+  void exitToImm(uint32_t pc) {
+    e.storeImm(REG_GPR, gprOffset(PC), pc);
+    exitWith(JIT_EXIT_NEXT);
+  }
+
+  void exitToReg(int reg) {
+    e.store(REG_GPR, gprOffset(PC), reg);
+    exitWith(JIT_EXIT_NEXT);
+  }
+
+  // Result in EAX is written to the guest register, writing PC ends the block
+  void writeResult(uint8_t reg) {
+    if ( reg == PC ) exitToReg(RAX);
+    else e.mov(host[reg], RAX);
+  }
+
+  void callHelper(const void* helper) {
+    e.mov64(RDI, REG_CONTEXT);
+    e.movImm64(RAX, (uint64_t)helper);
+    e.call(RAX);
+  }
+
+  // Walks the page table for address in EAX, leaves page pointer in RDX and page offset in ECX
+  // Jumps to slow path are added to the list
+  void walk(std::vector<size_t>& slow) {
+    e.mov(RCX, RAX);
+    e.shrImm(RCX, PAGE_BITS + PT_TABLE_BITS);
+    e.movImm64(RDX, (uint64_t)page_directory);
+    e.load64Index8(RDX, RDX, RCX);
+    e.test64(RDX, RDX);
+    slow.push_back(e.jcc(COND_E));
+    e.mov(RCX, RAX);
+    e.shrImm(RCX, PAGE_BITS);
+    e.andImm(RCX, PT_TABLE_SIZE - 1);
+    e.load64Index8(RDX, RDX, RCX);
+    e.test64(RDX, RDX);
+    slow.push_back(e.jcc(COND_E));
+    e.mov(RCX, RAX);
+    e.andImm(RCX, PAGE_MASK);
+    e.cmpImm(RCX, PAGE_SIZE - 4);
+    slow.push_back(e.jcc(COND_A));
+  }
+
+  // Reads word at address in EAX into EAX, memory mapped registers are read through the helper so they are counted
+  void emitLoad() {
+    std::vector<size_t> slow;
+    e.cmpImm(RAX, MMIO_PAGE);
+    slow.push_back(e.jcc(COND_AE));
+    walk(slow);
+    e.loadIndex(RAX, RDX, RCX);
+    size_t done = e.jmp();
+
+    for ( size_t at : slow ) e.patch(at);
+    spill();
+    e.mov(RSI, RAX);
+    callHelper((const void*)read_helper);
+    reload();
+
+    e.patch(done);
+  }
+
+  // Writes ESI to address in EAX, if leave_on_code is set block is left when the store hits translated code
+  void emitStore(bool leave_on_code, uint32_t next_pc) {
+    std::vector<size_t> slow;
+    e.cmpImm(RAX, MMIO_PAGE);
+    slow.push_back(e.jcc(COND_AE));
+    e.mov(RCX, RAX);
+    e.shrImm(RCX, PAGE_BITS);
+    e.movImm64(RDX, (uint64_t)code_map);
+    e.cmpByteIndexZero(RDX, RCX);
+    slow.push_back(e.jcc(COND_NE));
+    walk(slow);
+    e.storeIndex(RDX, RCX, RSI);
+    // Interpreter marks pages on write, inline stores have to do it themselves
+    if ( dirty_map ) {
+      e.mov(RCX, RAX);
+      e.shrImm(RCX, PAGE_BITS);
+      e.movImm64(RDX, (uint64_t)dirty_map);
+      e.storeByteIndexOne(RDX, RCX);
+    }
+    size_t done = e.jmp();
+
+    for ( size_t at : slow ) e.patch(at);
+    spill();
+    e.mov(RDX, RSI);
+    e.mov(RSI, RAX);
+    callHelper((const void*)write_helper);
+    reload();
+    if ( leave_on_code ) {
+      e.cmpImm(RAX, 0);
+      size_t stay = e.jcc(COND_E);
+      e.storeImm(REG_GPR, gprOffset(PC), next_pc);
+      exitWith(retired);
+      e.patch(stay);
+    }
+
+    e.patch(done);
+  }
+
+  // EAX = gpr[a] + gpr[b] + disp
+  void effectiveAddress(uint8_t a, uint8_t b, uint32_t disp, uint32_t next_pc) {
+    get(RAX, a, next_pc);
+    get(RCX, b, next_pc);
+    e.add(RAX, RCX);
+    e.addImm(RAX, disp);
+  }
+
+  void pushNextPc(uint32_t next_pc) {
+    e.addImm(host[SP], -4);
+    e.mov(RAX, host[SP]);
+    e.movImm(RSI, next_pc);
+    // Call completes even if it overwrites code, block ends with it anyway
+    emitStore(false, next_pc);
+  }
+
+  bool emitInstruction(const DecodedInstr& d, uint32_t next_pc);
+
+public:
+
+  BlockCompiler(X86Emitter& e, const void* page_directory, const uint8_t* code_map, uint8_t* dirty_map, JitReadHelper read_helper, JitWriteHelper write_helper)
+    : e(e), page_directory(page_directory), code_map(code_map), dirty_map(dirty_map), read_helper(read_helper), write_helper(write_helper) {};
+
+  bool compile(const Block& block);
+
+};
+
+uint32_t BlockCompiler::usedRegisters(const DecodedInstr& d) {
+  uint32_t a = 1 << d.reg_A, b = 1 << d.reg_B, c = 1 << d.reg_C;
+  switch (d.op) {
+    case OP_NOT: case OP_LD_REG: case OP_LD_POP: return a | b;
+    case OP_XCHG: return b | c;
+    case OP_CSRRD: case OP_JMP: case OP_JMP_MEM: return a;
+    case OP_ST_PUSH: return a | c;
+    case OP_CALL: case OP_CALL_MEM: return a | b | (1 << SP);
+    default: return a | b | c;
+  }
+}
+
+bool BlockCompiler::emitInstruction(const DecodedInstr& d, uint32_t next_pc) {
+  switch (d.op) {
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND: case OP_OR: case OP_XOR: {
+      get(RAX, d.reg_B, next_pc);
+      get(RCX, d.reg_C, next_pc);
+      switch (d.op) {
+        case OP_ADD: e.add(RAX, RCX); break;
+        case OP_SUB: e.sub(RAX, RCX); break;
+        case OP_MUL: e.imul(RAX, RCX); break;
+        case OP_AND: e.andr(RAX, RCX); break;
+        case OP_OR: e.orr(RAX, RCX); break;
+        default: e.xorr(RAX, RCX); break;
+      }
+      writeResult(d.reg_A);
+      return true;
+    }
+    case OP_DIV: {
+      // Same as the interpreter, host raises SIGFPE for division by zero
+      get(RAX, d.reg_B, next_pc);
+      get(RCX, d.reg_C, next_pc);
+      e.cdq();
+      e.idiv(RCX);
+      writeResult(d.reg_A);
+      return true;
+    }
+    case OP_SHL: case OP_SHR: {
+      get(RAX, d.reg_B, next_pc);
+      get(RCX, d.reg_C, next_pc);
+      if ( d.op == OP_SHL ) e.shlCl(RAX);
+      else e.shrCl(RAX);
+      writeResult(d.reg_A);
+      return true;
+    }
+    case OP_NOT: {
+      get(RAX, d.reg_B, next_pc);
+      e.notr(RAX);
+      writeResult(d.reg_A);
+      return true;
+    }
+    case OP_XCHG: {
+      if ( d.reg_B == PC || d.reg_C == PC ) return false;
+      e.mov(RAX, host[d.reg_B]);
+      e.mov(RCX, host[d.reg_C]);
+      e.mov(host[d.reg_B], RCX);
+      e.mov(host[d.reg_C], RAX);
+      return true;
+    }
+    case OP_LD_REG: {
+      get(RAX, d.reg_B, next_pc);
+      e.addImm(RAX, d.disp);
+      writeResult(d.reg_A);
+      return true;
+    }
+    case OP_CSRRD: {
+      if ( d.reg_B >= CSR_CNT ) return false;
+      e.load(RAX, REG_GPR, csr_offset + d.reg_B * 4);
+      writeResult(d.reg_A);
+      return true;
+    }
+    case OP_LD_MEM: {
+      effectiveAddress(d.reg_B, d.reg_C, d.disp, next_pc);
+      emitLoad();
+      writeResult(d.reg_A);
+      return true;
+    }
+    case OP_LD_POP: {
+      if ( d.reg_B == PC ) return false;
+      e.mov(RAX, host[d.reg_B]);
+      emitLoad();
+      if ( d.reg_A == PC ) {
+        e.addImm(host[d.reg_B], d.disp);
+        exitToReg(RAX);
+      } else {
+        e.mov(host[d.reg_A], RAX);
+        e.addImm(host[d.reg_B], d.disp);
+      }
+      return true;
+    }
+    case OP_ST: {
+      effectiveAddress(d.reg_A, d.reg_B, d.disp, next_pc);
+      get(RSI, d.reg_C, next_pc);
+      emitStore(true, next_pc);
+      return true;
+    }
+    case OP_ST_PUSH: {
+      if ( d.reg_A == PC ) return false;
+      e.addImm(host[d.reg_A], d.disp);
+      e.mov(RAX, host[d.reg_A]);
+      get(RSI, d.reg_C, next_pc);
+      emitStore(true, next_pc);
+      return true;
+    }
+    case OP_ST_MEM: {
+      effectiveAddress(d.reg_A, d.reg_B, d.disp, next_pc);
+      emitLoad();
+      get(RSI, d.reg_C, next_pc);
+      emitStore(true, next_pc);
+      return true;
+    }
+    case OP_JMP: {
+      get(RAX, d.reg_A, next_pc);
+      e.addImm(RAX, d.disp);
+      exitToReg(RAX);
+      return true;
+    }
+    case OP_JMP_MEM: {
+      get(RAX, d.reg_A, next_pc);
+      e.addImm(RAX, d.disp);
+      emitLoad();
+      exitToReg(RAX);
+      return true;
+    }
+    case OP_BEQ: case OP_BNE: case OP_BGT: case OP_BEQ_MEM: case OP_BNE_MEM: case OP_BGT_MEM: {
+      int cond = ( d.op == OP_BEQ || d.op == OP_BEQ_MEM ) ? COND_E : ( ( d.op == OP_BNE || d.op == OP_BNE_MEM ) ? COND_NE : COND_G );
+      get(RCX, d.reg_B, next_pc);
+      get(RDX, d.reg_C, next_pc);
+      e.cmp(RCX, RDX);
+      size_t taken = e.jcc(cond);
+      exitToImm(next_pc);
+      e.patch(taken);
+      get(RAX, d.reg_A, next_pc);
+      e.addImm(RAX, d.disp);
+      exitToReg(RAX);
+      return true;
+    }
+    case OP_CALL: {
+      pushNextPc(next_pc);
+      effectiveAddress(d.reg_A, d.reg_B, d.disp, next_pc);
+      exitToReg(RAX);
+      return true;
+    }
+    case OP_CALL_MEM: {
+      pushNextPc(next_pc);
+      effectiveAddress(d.reg_A, d.reg_B, d.disp, next_pc);
+      emitLoad();
+      exitToReg(RAX);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool BlockCompiler::compile(const Block& block) {
+  uint32_t used = 0;
+  for ( uint32_t i = 0; i < block.size; i++ ) {
+    used |= usedRegisters(block.ops[i]);
+  }
+  used &= ~(1u << PC);
+
+  int count = 0;
+  for ( int i = 0; i < GPR_CNT; i++ ) {
+    if ( !(used & (1 << i)) ) continue;
+    if ( count == sizeof(allocatable) / sizeof(allocatable[0]) ) return false;
+    host[i] = allocatable[count++];
+  }
+  allocated = used;
+
+  // Prologue, 6 pushes and return address leave stack misaligned by 8
+  for ( int reg : saved ) e.push(reg);
+  e.subRsp(8);
+  e.mov64(REG_GPR, RDI);
+  e.mov64(REG_CONTEXT, RSI);
+  reload();
+
+  bool terminated = false;
+  for ( uint32_t i = 0; i < block.size; i++ ) {
+    const DecodedInstr& d = block.ops[i];
+    retired = i + 1;
+    if ( !emitInstruction(d, block.start + 4 * (i + 1)) ) return false;
+    terminated = i == block.size - 1 && BlockCache::endsBlock(d);
+  }
+  if ( !terminated ) exitToImm(block.end);
+
+  // Epilogue, every exit jumps here with status in EAX
+  for ( size_t at : exits ) e.patch(at);
+  e.addRsp(8);
+  for ( int i = sizeof(saved) / sizeof(saved[0]) - 1; i >= 0; i-- ) e.pop(saved[i]);
+  e.ret();
+
+  return true;
+}
+
+bool JitCompiler::init(const Memory& memory, const BlockCache& block_cache, JitReadHelper read_helper, JitWriteHelper write_helper) {
+  void* buffer = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if ( buffer == MAP_FAILED ) return false;
+
+  code = (uint8_t*)buffer;
+  page_directory = memory.rawPageDirectory();
+  code_map = block_cache.getCodeMap();
+  dirty_map = memory.getDirtyMap();
+  this->read_helper = read_helper;
+  this->write_helper = write_helper;
+  return true;
+}
+
+JitCompiler::~JitCompiler() {
+  if ( code ) munmap(code, JIT_CODE_SIZE);
+}
+
+bool JitCompiler::compile(Block& block) {
+  if ( !code || full ) return false;
+
+  // IRET writes STATUS, which needs the emulator to unmask interrupts, such blocks are left to the interpreter
+  if ( block.ops[block.size - 1].op == OP_IRET ) {
+    rejected++;
+    return false;
+  }
+
+  X86Emitter e(code + used, JIT_CODE_SIZE - used);
+  BlockCompiler compiler(e, page_directory, code_map, dirty_map, read_helper, write_helper);
+
+  if ( !compiler.compile(block) ) {
+    rejected++;
+    return false;
+  }
+  if ( e.overflowed() ) {
+    full = true;
+    return false;
+  }
+
+  block.native = (JitFunction)(code + used);
+  used += e.size();
+  compiled++;
+  return true;
+}
+
+#else
+
+// JIT is only supported on x86-64 Linux hosts
+
+bool JitCompiler::init(const Memory& memory, const BlockCache& block_cache, JitReadHelper read_helper, JitWriteHelper write_helper) {
+  return false;
+}
+
+JitCompiler::~JitCompiler() {}
+
+bool JitCompiler::compile(Block& block) {
+  return false;
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include "../../inc/emulator/Emulator.hpp"
+
+void Emulator::setUpJit() {
+  if ( !jit.init(memory, block_cache, Emulator::jitReadWord, Emulator::jitWriteWord) ) {
+    std::cout << "emulator: warning : JIT is not supported on this host, using block engine" << std::endl;
+    engine = ENGINE_BLOCK;
+  }
+}
+
+uint32_t Emulator::jitReadWord(void* context, uint32_t address) {
+  Emulator* emulator = (Emulator*)context;
+  return emulator->loadWord(address);
+}
+
+uint32_t Emulator::jitWriteWord(void* context, uint32_t address, uint32_t word) {
+  Emulator* emulator = (Emulator*)context;
+  emulator->storeWord(address, word);
+  return emulator->code_written;
+}
+
+uint32_t aotReadWord(void* context, uint32_t address) {
+  return Emulator::jitReadWord(context, address);
+}
+
+uint32_t aotWriteWord(void* context, uint32_t address, uint32_t word) {
+  return Emulator::jitWriteWord(context, address, word);
+}
+
+void Emulator::startLockstep(Block* block) {
+  lockstep_block = block;
+  std::copy(cpu.gpr, cpu.gpr + GPR_CNT, lockstep_gpr);
+  std::copy(cpu.csr, cpu.csr + CSR_CNT, lockstep_csr);
+  store_journal.clear();
+  journaling = true;
+}
+
+void Emulator::finishLockstep() {
+  Block* block = lockstep_block;
+  lockstep_block = nullptr;
+  journaling = false;
+
+  // Remember what the interpreter did, then undo it
+  uint32_t interpreted_gpr[GPR_CNT], interpreted_csr[CSR_CNT];
+  std::copy(cpu.gpr, cpu.gpr + GPR_CNT, interpreted_gpr);
+  std::copy(cpu.csr, cpu.csr + CSR_CNT, interpreted_csr);
+  bool interpreted_code_written = code_written;
+  std::vector<uint32_t> written;
+  for ( auto& entry : store_journal ) {
+    written.push_back(memory.readWord(entry.first));
+  }
+  for ( auto it = store_journal.rbegin(); it != store_journal.rend(); it++ ) {
+    memory.writeWord(it->first, it->second);
+  }
+
+  // Interrupt requests could have been changed by devices in the meantime, so only registers are restored
+  std::copy(lockstep_gpr, lockstep_gpr + GPR_CNT, cpu.gpr);
+  std::copy(lockstep_csr, lockstep_csr + CSR_CNT, cpu.csr);
+  code_written = false;
+
+  replaying = true;
+  block->native(cpu.gpr, this);
+  replaying = false;
+
+  bool mismatch = code_written != interpreted_code_written;
+  for ( int i = 0; i < GPR_CNT; i++ ) {
+    if ( cpu.gpr[i] != interpreted_gpr[i] ) mismatch = true;
+  }
+  for ( int i = 0; i < CSR_CNT; i++ ) {
+    if ( cpu.csr[i] != interpreted_csr[i] ) mismatch = true;
+  }
+  for ( size_t i = 0; i < store_journal.size(); i++ ) {
+    if ( memory.readWord(store_journal[i].first) != written[i] ) mismatch = true;
+  }
+
+  if ( !mismatch ) return;
+
+  std::cout << "\nemulator: error : JIT lockstep mismatch in block at ";
+  Helper::printHex(std::cout, block->start, 10, true);
+  std::cout << '\n';
+  for ( int i = 0; i < GPR_CNT; i++ ) {
+    if ( cpu.gpr[i] == interpreted_gpr[i] ) continue;
+    std::cout << std::setw(4) << ("r" + std::to_string(i)) << ": interpreter=";
+    Helper::printHex(std::cout, interpreted_gpr[i], 10, true);
+    std::cout << " jit=";
+    Helper::printHex(std::cout, cpu.gpr[i], 10, true);
+    std::cout << '\n';
+  }
+  for ( int i = 0; i < CSR_CNT; i++ ) {
+    if ( cpu.csr[i] == interpreted_csr[i] ) continue;
+    std::cout << std::setw(4) << ("csr" + std::to_string(i)) << ": interpreter=";
+    Helper::printHex(std::cout, interpreted_csr[i], 10, true);
+    std::cout << " jit=";
+    Helper::printHex(std::cout, cpu.csr[i], 10, true);
+    std::cout << '\n';
+  }
+  for ( size_t i = 0; i < store_journal.size(); i++ ) {
+    uint32_t value = memory.readWord(store_journal[i].first);
+    if ( value == written[i] ) continue;
+    std::cout << "mem[";
+    Helper::printHex(std::cout, store_journal[i].first, 10, true);
+    std::cout << "]: interpreter=";
+    Helper::printHex(std::cout, written[i], 10, true);
+    std::cout << " jit=";
+    Helper::printHex(std::cout, value, 10, true);
+    std::cout << '\n';
+  }
+  std::cout << std::endl;
+
+  restoreTerminal();
+  exit(-1);
+}
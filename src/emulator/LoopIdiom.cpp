@@ -0,0 +1,134 @@
+#include "../../inc/emulator/LoopIdiom.hpp"
+
+LoopIdiom* LoopIdiom::recognize(const Memory& memory, uint32_t start) {
+  if ( start & 3 ) return nullptr;
+
+  LoopIdiom idiom;
+  idiom.start = start;
+
+  // Body ends with a branch back to start, whole body has to be on one page so writes to it drop the translation
+  uint32_t size = 0;
+  for ( uint32_t i = 0; i < IDIOM_MAX_INSTRUCTIONS && !size; i++ ) {
+    uint32_t pc = start + i * 4;
+    if ( (pc ^ start) >> PAGE_BITS ) return nullptr;
+    DecodeCache::decode(memory.readWord(pc), idiom.ops[i]);
+    const DecodedInstr& op = idiom.ops[i];
+    if ( op.op == OP_BNE && op.reg_A == PC && pc + 4 + op.disp == start ) size = i + 1;
+  }
+  if ( !size ) return nullptr;
+  idiom.size = size;
+
+  // First pass finds registers the body writes to, every one of them is written once
+  uint16_t written = 0;
+  uint16_t loaded = 0;
+  int8_t defined[GPR_CNT];
+  for ( int r = 0; r < GPR_CNT; r++ ) {
+    idiom.updated[r] = UINT8_MAX;
+    defined[r] = -1;
+  }
+  for ( uint32_t i = 0; i + 1 < size; i++ ) {
+    const DecodedInstr& op = idiom.ops[i];
+    uint8_t reg = op.reg_A;
+    switch (op.op) {
+      case OP_ADD: case OP_SUB: case OP_LD_REG: {
+        // Register is advanced by a constant or by a register the loop doesn't change
+        int step_reg = -1;
+        if ( op.op == OP_LD_REG && op.reg_B == reg ) step_reg = -1;
+        else if ( op.op != OP_LD_REG && op.reg_B == reg && op.reg_C != reg ) step_reg = op.reg_C;
+        else if ( op.op == OP_ADD && op.reg_C == reg && op.reg_B != reg ) step_reg = op.reg_B;
+        else return nullptr;
+        idiom.induction |= 1u << reg;
+        idiom.step_reg[reg] = step_reg;
+        idiom.step_sign[reg] = op.op == OP_SUB ? -1 : 1;
+        idiom.step_const[reg] = op.disp;
+        idiom.updated[reg] = i;
+        break;
+      }
+      case OP_LD_MEM:
+        if ( idiom.loads == 2 ) return nullptr;
+        idiom.load[idiom.loads++] = { (uint8_t)i, op.reg_B, op.reg_C, op.disp };
+        loaded |= 1u << reg;
+        defined[reg] = i;
+        break;
+      case OP_ST:
+        if ( idiom.kind != IDIOM_NONE ) return nullptr;
+        idiom.kind = IDIOM_FILL;
+        idiom.store = { (uint8_t)i, op.reg_A, op.reg_B, op.disp };
+        continue;
+      case OP_BNE:
+        if ( idiom.compare_exit || op.reg_A != PC ) return nullptr;
+        // Exit has to leave the loop
+        if ( (i + 1) * 4 + op.disp < size * 4 ) return nullptr;
+        idiom.compare_exit = i;
+        continue;
+      default:
+        return nullptr;
+    }
+    if ( reg == PC || (written & (1u << reg)) ) return nullptr;
+    written |= 1u << reg;
+  }
+
+  // Second pass checks the uses, PC is used only by the branches
+  auto invariant = [&](uint8_t reg) { return reg != PC && !(written & (1u << reg)); };
+  auto addressing = [&](uint8_t reg) { return reg != PC && !(loaded & (1u << reg)); };
+  auto loadedBefore = [&](uint8_t reg, uint32_t at) { return (loaded & (1u << reg)) && defined[reg] < (int)at; };
+
+  for ( uint32_t i = 0; i < size; i++ ) {
+    const DecodedInstr& op = idiom.ops[i];
+    switch (op.op) {
+      case OP_ADD: case OP_SUB:
+        if ( !invariant(idiom.step_reg[op.reg_A]) ) return nullptr;
+        break;
+      case OP_LD_MEM:
+        if ( !addressing(op.reg_B) || !addressing(op.reg_C) ) return nullptr;
+        break;
+      case OP_ST:
+        if ( !addressing(op.reg_A) || !addressing(op.reg_B) ) return nullptr;
+        if ( loadedBefore(op.reg_C, i) ) idiom.kind = IDIOM_COPY;
+        else if ( !invariant(op.reg_C) ) return nullptr;
+        break;
+      case OP_BNE:
+        if ( i == size - 1 ) {
+          if ( !addressing(op.reg_B) || !addressing(op.reg_C) ) return nullptr;
+        } else if ( op.reg_B == op.reg_C || !loadedBefore(op.reg_B, i) || !loadedBefore(op.reg_C, i) ) {
+          return nullptr;
+        }
+        break;
+    }
+  }
+
+  // Copy stores the word it loaded, fill stores a register the loop doesn't change, compare doesn't store
+  if ( idiom.kind == IDIOM_COPY && (idiom.loads != 1 || idiom.compare_exit) ) return nullptr;
+  if ( idiom.kind == IDIOM_FILL && (idiom.loads != 0 || idiom.compare_exit) ) return nullptr;
+  if ( idiom.kind == IDIOM_NONE ) {
+    if ( idiom.loads != 2 || !idiom.compare_exit ) return nullptr;
+    idiom.kind = IDIOM_COMPARE;
+  }
+
+  return new LoopIdiom(idiom);
+}
+
+/*
+  Registers the loop branch compares change by a fixed amount every iteration, so after k iterations their
+  difference is diff + k * delta(mod 2^32). With delta = 2^shift * odd, k * odd = -diff / 2^shift has to hold modulo
+  2^(32 - shift), and odd has an inverse there
+*/
+uint64_t LoopIdiom::iterations(const uint32_t* gpr) const {
+  const DecodedInstr& branch = ops[size - 1];
+  uint32_t diff = gpr[branch.reg_B] - gpr[branch.reg_C];
+  uint32_t delta = step(gpr, branch.reg_B) - step(gpr, branch.reg_C);
+  if ( delta == 0 ) return diff == 0 ? 1 : 0;
+
+  int shift = __builtin_ctz(delta);
+  uint32_t target = -diff;
+  if ( target & ((1u << shift) - 1) ) return 0;
+
+  // Newton's iteration, every step doubles the number of correct low bits
+  uint32_t odd = delta >> shift;
+  uint32_t inverse = odd;
+  for ( int i = 0; i < 5; i++ ) inverse *= 2 - odd * inverse;
+
+  uint64_t period = 1ull << (32 - shift);
+  uint64_t count = (uint32_t)((target >> shift) * inverse) & (period - 1);
+  return count ? count : period;
+}
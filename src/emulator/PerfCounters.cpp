@@ -0,0 +1,103 @@
+#include "../../inc/emulator/PerfCounters.hpp"
+#include "../../inc/Helper.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// OC/MOD, name, and the number of memory words read and written by every handler
+struct OpInfo {
+  uint8_t oc_mod;
+  const char* name;
+  uint8_t reads;
+  uint8_t writes;
+};
+
+static const OpInfo op_info[OP_COUNT] = {
+  { 0x00, "none", 0, 0 },
+  { 0x00, "halt", 0, 0 },       { 0x10, "int", 0, 0 },          { 0x11, "wfi", 0, 0 },
+  { 0x20, "call", 0, 1 },       { 0x21, "call mem", 1, 1 },
+  { 0x30, "jmp", 0, 0 },        { 0x31, "beq", 0, 0 },          { 0x32, "bne", 0, 0 },        { 0x33, "bgt", 0, 0 },
+  { 0x38, "jmp mem", 1, 0 },    { 0x39, "beq mem", 0, 0 },      { 0x3a, "bne mem", 0, 0 },    { 0x3b, "bgt mem", 0, 0 },
+  { 0x40, "xchg", 0, 0 },       { 0x50, "add", 0, 0 },          { 0x51, "sub", 0, 0 },
+  { 0x52, "mul", 0, 0 },        { 0x53, "div", 0, 0 },
+  { 0x60, "not", 0, 0 },        { 0x61, "and", 0, 0 },          { 0x62, "or", 0, 0 },         { 0x63, "xor", 0, 0 },
+  { 0x70, "shl", 0, 0 },        { 0x71, "shr", 0, 0 },
+  { 0x80, "st", 0, 1 },         { 0x81, "push", 0, 1 },         { 0x82, "st mem", 1, 1 },
+  { 0x90, "csrrd", 0, 0 },      { 0x91, "ld reg", 0, 0 },       { 0x92, "ld mem", 1, 0 },     { 0x93, "pop", 1, 0 },
+  { 0x94, "csrwr", 0, 0 },      { 0x95, "csr or", 0, 0 },       { 0x96, "csr ld mem", 1, 0 }, { 0x97, "csr pop", 1, 0 },
+  { 0xff, "invalid", 0, 0 },
+  { 0x00, "block end", 0, 0 },
+  { 0x93, "iret", 2, 0 },       { 0x81, "push pair", 0, 2 },    { 0x93, "pop pair", 2, 0 },   { 0x92, "ld indirect", 2, 0 }
+};
+
+static const char* cause_names[CAUSE_CNT] = { "invalid instruction", "timer", "terminal", "software" };
+
+uint64_t PerfCounters::memoryReads() const {
+  uint64_t reads = 0;
+  for ( int i = 0; i < OP_COUNT; i++ ) reads += ops[i] * op_info[i].reads;
+  return reads;
+}
+
+// Interrupt entry pushes status and PC
+uint64_t PerfCounters::memoryWrites() const {
+  uint64_t writes = 0;
+  for ( int i = 0; i < OP_COUNT; i++ ) writes += ops[i] * op_info[i].writes;
+  for ( int i = 0; i < CAUSE_CNT; i++ ) writes += interrupts[i] * 2;
+  return writes;
+}
+
+// Instruction mix lists only handlers that ran, most frequent first
+void PerfCounters::print(std::ostream& os) const {
+  std::ios old_state(nullptr);
+  old_state.copyfmt(os);
+
+  os << "Performance: " << executed() << " instructions executed in " << std::fixed << std::setprecision(3)
+     << host_seconds << " s, " << std::setprecision(2) << mips() << " MIPS\n";
+  os << "Memory: " << memoryReads() << " reads, " << memoryWrites() << " writes, " << mmio_reads
+     << " memory mapped register reads, " << mmio_writes << " writes\n";
+  os << "Interrupts:";
+  for ( int i = 0; i < CAUSE_CNT; i++ ) os << (i ? ", " : " ") << interrupts[i] << " " << cause_names[i];
+  os << "\n";
+
+  std::vector<int> mix;
+  for ( int i = OP_HALT; i < OP_COUNT; i++ ) if ( ops[i] && i != OP_BLOCK_END ) mix.push_back(i);
+  std::stable_sort(mix.begin(), mix.end(), [this](int a, int b) { return ops[a] > ops[b]; });
+
+  uint64_t total = 0;
+  for ( int i : mix ) total += ops[i];
+  os << "Instruction mix:\n";
+  for ( int i : mix ) {
+    os << "  ";
+    if ( i == OP_INVALID ) os << "    ";
+    else Helper::printHex(os, op_info[i].oc_mod, 4, true);
+    os << "  " << std::left << std::setw(12) << op_info[i].name << std::right << std::setw(16) << ops[i]
+       << std::setw(8) << std::setprecision(2) << 100.0 * ops[i] / total << "%\n";
+  }
+
+  os.copyfmt(old_state);
+}
+
+void PerfCounters::writeJson(std::ostream& os) const {
+  std::ios old_state(nullptr);
+  old_state.copyfmt(os);
+
+  os << "{\"retired\": " << retired << ", \"skipped\": " << skipped << ", \"executed\": " << executed()
+     << ", \"host_seconds\": " << std::fixed << std::setprecision(6) << host_seconds
+     << ", \"mips\": " << std::setprecision(3) << mips()
+     << ", \"memory_reads\": " << memoryReads() << ", \"memory_writes\": " << memoryWrites()
+     << ", \"mmio_reads\": " << mmio_reads << ", \"mmio_writes\": " << mmio_writes << ", \"interrupts\": {";
+  for ( int i = 0; i < CAUSE_CNT; i++ ) os << (i ? ", " : "") << "\"" << cause_names[i] << "\": " << interrupts[i];
+
+  // Every OC/MOD is listed, handlers that never ran included
+  os << "}, \"opcodes\": {";
+  for ( int i = OP_HALT; i < OP_INVALID; i++ ) {
+    os << (i > OP_HALT ? ", " : "") << "\"";
+    Helper::printHex(os, op_info[i].oc_mod, 4, true);
+    os << "\": " << ops[i];
+  }
+  os << ", \"invalid\": " << ops[OP_INVALID] << "}, \"fused\": {";
+  for ( int i = OP_IRET; i < OP_COUNT; i++ ) os << (i > OP_IRET ? ", " : "") << "\"" << op_info[i].name << "\": " << ops[i];
+  os << "}}";
+
+  os.copyfmt(old_state);
+}
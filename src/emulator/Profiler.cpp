@@ -0,0 +1,117 @@
+#include "../../inc/emulator/Profiler.hpp"
+
+#include <algorithm>
+
+void Profiler::loadSymbols(Elf32File& file) {
+  Table<Elf32_Sym*>& table = *file.getSymbolTable();
+
+  for ( uint32_t i = 0; i < table.size(); i++ ) {
+    Elf32_Sym& symbol = *table.get(i);
+    // Undefined and absolute symbols aren't addresses in the program
+    if ( symbol.st_shndx == SHN_UNDEF || symbol.st_shndx == (Elf32_Half)SHN_ABS ) continue;
+
+    // Label at the start of a section is a better name than the section itself
+    std::string name = file.getString(symbol.st_name);
+    if ( ELF32_ST_TYPE(symbol.st_info) == STT_SECTION ) symbols.emplace(symbol.st_value, name);
+    else symbols[symbol.st_value] = name;
+  }
+}
+
+std::string Profiler::findSymbol(uint32_t address) const {
+  auto next = symbols.upper_bound(address);
+  if ( next == symbols.begin() ) return "";
+  return std::prev(next)->second;
+}
+
+std::string Profiler::frameName(uint32_t address) const {
+  std::string name = findSymbol(address);
+  if ( name != "" ) return name;
+
+  std::ostringstream hex;
+  Helper::printHex(hex, address, 10, true);
+  return hex.str();
+}
+
+std::string Profiler::symbolize(uint32_t address) const {
+  auto next = symbols.upper_bound(address);
+  if ( next == symbols.begin() ) return "?";
+
+  auto symbol = std::prev(next);
+  std::string name = symbol->second;
+  if ( address != symbol->first ) {
+    std::ostringstream offset;
+    offset << std::hex << address - symbol->first;
+    name += "+0x" + offset.str();
+  }
+  return name;
+}
+
+bool Profiler::writeReport(std::string file_name) const {
+  std::vector<std::pair<uint64_t, uint32_t>> hot;
+  std::map<std::string, uint64_t> by_symbol;
+  uint64_t total = 0;
+
+  pages.forEach([&](uint32_t page, PageCounts& entry) {
+    for ( uint32_t i = 0; i < PAGE_SIZE / 4; i++ ) {
+      if ( !entry.counts[i] ) continue;
+      uint32_t address = page + i * 4;
+      hot.push_back(std::make_pair(entry.counts[i], address));
+      by_symbol[findSymbol(address)] += entry.counts[i];
+      total += entry.counts[i];
+    }
+  });
+
+  std::vector<std::pair<uint64_t, std::string>> functions;
+  for ( auto& symbol : by_symbol ) functions.push_back(std::make_pair(symbol.second, symbol.first));
+
+  // Hottest first, ties in address(or name) order
+  auto hotter = [](const auto& a, const auto& b) { return a.first != b.first ? a.first > b.first : a.second < b.second; };
+  std::sort(hot.begin(), hot.end(), hotter);
+  std::sort(functions.begin(), functions.end(), hotter);
+
+  std::ofstream fout(file_name, std::ios::trunc);
+  if ( !fout.is_open() ) return false;
+
+  auto percent = [total](uint64_t count) { return total ? 100.0 * count / total : 0.0; };
+
+  fout << "Profile: " << total << " instructions retired at " << hot.size() << " addresses\n\n";
+
+  fout << "Hottest symbols:\n" << std::right;
+  for ( size_t i = 0; i < functions.size() && i < PROFILE_TOP; i++ ) {
+    fout << std::setw(16) << std::dec << functions[i].first << std::setw(8) << std::fixed << std::setprecision(2)
+         << percent(functions[i].first) << "%   " << (functions[i].second != "" ? functions[i].second : "?") << '\n';
+  }
+
+  fout << "\nHottest addresses:\n";
+  for ( size_t i = 0; i < hot.size() && i < PROFILE_TOP; i++ ) {
+    fout << std::setw(16) << std::dec << hot[i].first << std::setw(8) << std::fixed << std::setprecision(2)
+         << percent(hot[i].first) << "%   ";
+    Helper::printHex(fout, hot[i].second, 10, true);
+    fout << "   " << symbolize(hot[i].second) << '\n';
+  }
+
+  fout.close();
+  return !fout.fail();
+}
+
+// Frames are return addresses, so they are named after the function that holds the call before them
+bool Profiler::writeFolded(std::string file_name) const {
+  // Different addresses can have the same names, so stacks are merged once more
+  std::map<std::string, uint64_t> folded;
+
+  for ( auto& sample : stacks ) {
+    const std::vector<uint32_t>& addresses = sample.first;
+    std::string stack;
+    for ( size_t j = addresses.size() - 1; j > 0; j-- ) stack += frameName(addresses[j] - 4) + ";";
+    stack += frameName(addresses[0]);
+    folded[stack] += sample.second;
+  }
+
+  std::ofstream fout(file_name, std::ios::trunc);
+  if ( !fout.is_open() ) return false;
+
+  for ( auto& stack : folded ) fout << stack.first << " " << stack.second << '\n';
+
+  fout.close();
+  return !fout.fail();
+}
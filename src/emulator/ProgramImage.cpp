@@ -0,0 +1,72 @@
+#include "../../inc/emulator/ProgramImage.hpp"
+
+bool ProgramImage::load(std::string file_name, Memory& memory) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if ( fd < 0 ) return false;
+
+  struct stat info;
+  if ( fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(Elf32_Ehdr) ) {
+    ::close(fd);
+    return false;
+  }
+
+  // Private mapping, writes to guest pages never reach the file
+  void* mapped = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if ( mapped == MAP_FAILED ) return false;
+
+  uint8_t* data = (uint8_t*)mapped;
+  size_t size = info.st_size;
+
+  // Program header table comes right after the file header
+  Elf32_Ehdr header;
+  memcpy(&header, data, sizeof(header));
+  if ( header.e_type != ET_EXEC || sizeof(header) + (uint64_t)header.e_phnum * sizeof(Elf32_Phdr) > size ) {
+    munmap(data, size);
+    return false;
+  }
+
+  for ( int i = 0; i < header.e_phnum; i++ ) {
+    Elf32_Phdr segment;
+    memcpy(&segment, data + sizeof(header) + i * sizeof(Elf32_Phdr), sizeof(segment));
+    if ( (uint64_t)segment.p_offset + segment.p_size > size ) {
+      munmap(data, size);
+      return false;
+    }
+  }
+
+  mappings.push_back(std::make_pair(data, size));
+  memory.borrowPages(data, (size + PAGE_MASK) / PAGE_SIZE);
+  for ( int i = 0; i < header.e_phnum; i++ ) {
+    Elf32_Phdr segment;
+    memcpy(&segment, data + sizeof(header) + i * sizeof(Elf32_Phdr), sizeof(segment));
+    if ( segment.p_type == PT_LOAD ) loadSegment(data, segment, memory);
+  }
+
+  return true;
+}
+
+// Page can be mapped only if the segment covers all of it and nothing was written to it before(an edge of another
+// segment)
+void ProgramImage::loadSegment(const uint8_t* data, const Elf32_Phdr& segment, Memory& memory) {
+  uint64_t address = segment.p_vaddr;
+  uint64_t end = address + segment.p_size;
+  const uint8_t* bytes = data + segment.p_offset;
+
+  while ( address < end ) {
+    uint64_t page_end = (address & ~(uint64_t)PAGE_MASK) + PAGE_SIZE;
+    uint32_t chunk = std::min(end, page_end) - address;
+    if ( chunk == PAGE_SIZE && !memory.hasPage(address) ) {
+      memory.mapPage(address, (uint8_t*)bytes);
+    } else {
+      memory.writeBytes(address, bytes, chunk);
+    }
+    address += chunk;
+    bytes += chunk;
+  }
+}
+
+void ProgramImage::close() {
+  for ( auto& mapping : mappings ) munmap(mapping.first, mapping.second);
+  mappings.clear();
+}
@@ -0,0 +1,76 @@
+#include "../../inc/emulator/Snapshot.hpp"
+
+bool Snapshot::save(std::string file_name, SnapshotHeader& header, const std::string& input, const Memory& memory) {
+  std::vector<uint32_t> addresses;
+  memory.forEachPage([&](uint32_t address, const uint8_t*) { addresses.push_back(address); });
+
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.page_count = addresses.size();
+  header.input_size = input.size();
+
+  std::ofstream fout(file_name, std::ios::binary | std::ios::trunc);
+  if ( !fout.is_open() ) return false;
+
+  fout.write((const char*)&header, sizeof(header));
+  fout.write(input.data(), input.size());
+  fout.write((const char*)addresses.data(), addresses.size() * 4);
+
+  // Pages start at an aligned offset so they can be mapped in place
+  uint64_t written = addressesEnd(header.input_size, header.page_count);
+  std::string padding(pagesOffset(header.input_size, header.page_count) - written, '\0');
+  fout.write(padding.data(), padding.size());
+
+  memory.forEachPage([&](uint32_t, const uint8_t* bytes) { fout.write((const char*)bytes, PAGE_SIZE); });
+
+  fout.close();
+  return !fout.fail();
+}
+
+bool Snapshot::load(std::string file_name, SnapshotHeader& header, std::string& input, Memory& memory) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if ( fd < 0 ) return false;
+
+  struct stat info;
+  if ( fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(header) ) {
+    ::close(fd);
+    return false;
+  }
+
+  // Private mapping, writes to guest pages never reach the file
+  void* mapped = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if ( mapped == MAP_FAILED ) return false;
+
+  close();
+  data = (uint8_t*)mapped;
+  size = info.st_size;
+
+  memcpy(&header, data, sizeof(header));
+  // Input and page addresses have to fit in the file, and so do the pages after them
+  if ( header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION
+    || addressesEnd(header.input_size, header.page_count) > size
+    || pagesOffset(header.input_size, header.page_count) + (uint64_t)header.page_count * PAGE_SIZE > size ) {
+    close();
+    return false;
+  }
+
+  input.assign((const char*)data + sizeof(header), header.input_size);
+
+  const uint8_t* addresses = data + sizeof(header) + header.input_size;
+  uint8_t* pages = data + pagesOffset(header.input_size, header.page_count);
+  memory.borrowPages(pages, header.page_count);
+  for ( uint32_t i = 0; i < header.page_count; i++ ) {
+    uint32_t address;
+    memcpy(&address, addresses + i * 4, 4);
+    memory.mapPage(address, pages + i * PAGE_SIZE);
+  }
+
+  return true;
+}
+
+void Snapshot::close() {
+  if ( data ) munmap(data, size);
+  data = nullptr;
+  size = 0;
+}
@@ -0,0 +1,162 @@
+#include "../../inc/emulator/Terminal.hpp"
+
+bool Terminal::openInput(std::string file_name) {
+  headless = true;
+  int fd = file_name == "-" ? STDIN_FILENO : open(file_name.c_str(), O_RDONLY);
+  if ( fd < 0 ) return false;
+
+  char buffer[TERMINAL_RING_SIZE];
+  ssize_t count;
+  while ( (count = read(fd, buffer, sizeof(buffer))) != 0 ) {
+    if ( count < 0 ) {
+      if ( errno == EINTR ) continue;
+      break;
+    }
+    script.append(buffer, count);
+  }
+
+  if ( fd != STDIN_FILENO ) close(fd);
+  return count == 0;
+}
+
+bool Terminal::openOutput(std::string file_name) {
+  headless = true;
+  out_fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if ( out_fd < 0 ) {
+    out_fd = STDOUT_FILENO;
+    return false;
+  }
+  return true;
+}
+
+void Terminal::start() {
+  if ( started ) return;
+  started = true;
+
+  if ( headless ) return;
+
+  termios new_attr;
+
+  // Save old attributes so we can restore them at the end
+  tcgetattr(STDIN_FILENO, &old_attr);
+  tcgetattr(STDIN_FILENO, &new_attr);
+
+  // Disable echo and canonical mode(so it doesn't wait for line-delimeter char)
+  new_attr.c_lflag &= ~(ECHO | ICANON);
+
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &new_attr);
+
+  // Device thread waits with poll, reads must not block once it is woken up
+  old_flags = fcntl(STDIN_FILENO, F_GETFL);
+  fcntl(STDIN_FILENO, F_SETFL, old_flags | O_NONBLOCK);
+
+  running = true;
+  device_thread = new std::thread(&Terminal::deviceBody, this);
+}
+
+void Terminal::stop() {
+  if ( !started ) return;
+  started = false;
+
+  running = false;
+  if ( device_thread ) {
+    device_thread->join();
+    delete device_thread;
+    device_thread = nullptr;
+  }
+
+  flush();
+
+  if ( headless ) {
+    if ( out_fd != STDOUT_FILENO ) close(out_fd);
+    out_fd = STDOUT_FILENO;
+    return;
+  }
+
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &old_attr);
+  fcntl(STDIN_FILENO, F_SETFL, old_flags);
+}
+
+void Terminal::deviceBody() {
+  bool input_closed = false;
+
+  while ( running ) {
+    uint32_t free_slots = TERMINAL_RING_SIZE - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+
+    // Once stdin is closed, or while the ring is full, thread only flushes output
+    if ( input_closed || free_slots == 0 ) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(TERMINAL_FLUSH_MS));
+      flush();
+      continue;
+    }
+
+    pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    if ( poll(&fd, 1, TERMINAL_FLUSH_MS) > 0 ) {
+      uint8_t buffer[TERMINAL_RING_SIZE];
+      ssize_t count = read(STDIN_FILENO, buffer, free_slots);
+      if ( count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR) ) {
+        input_closed = true;
+      }
+
+      uint32_t current = head.load(std::memory_order_relaxed);
+      for ( ssize_t i = 0; i < count; i++ ) {
+        ring[(current + i) & (TERMINAL_RING_SIZE - 1)] = buffer[i];
+      }
+      if ( count > 0 ) head.store(current + count, std::memory_order_release);
+    }
+
+    flush();
+  }
+}
+
+std::string Terminal::takeInput() {
+  std::string input;
+  uint8_t c;
+  while ( readInput(c) ) input.push_back(c);
+  return input;
+}
+
+void Terminal::output(char c) {
+  if ( capturing ) {
+    captured.push_back(c);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(out_mutex);
+  out_buffer.push_back(c);
+  if ( c == '\n' || out_buffer.size() >= TERMINAL_OUT_THRESHOLD ) flushLocked();
+}
+
+// Whole text is buffered at once, and written out right away if it finishes a line or fills the buffer
+void Terminal::output(const std::string& text) {
+  if ( capturing ) {
+    captured += text;
+    return;
+  }
+  std::lock_guard<std::mutex> lock(out_mutex);
+  out_buffer += text;
+  if ( text.find('\n') != std::string::npos || out_buffer.size() >= TERMINAL_OUT_THRESHOLD ) flushLocked();
+}
+
+void Terminal::flush() {
+  std::lock_guard<std::mutex> lock(out_mutex);
+  flushLocked();
+}
+
+void Terminal::flushLocked() {
+  size_t written = 0;
+  while ( written < out_buffer.size() ) {
+    ssize_t count = write(out_fd, out_buffer.data() + written, out_buffer.size() - written);
+    if ( count < 0 ) {
+      if ( errno == EINTR ) continue;
+      // Stdout can be non blocking if it is the same file as stdin
+      if ( errno == EAGAIN ) {
+        pollfd fd = {out_fd, POLLOUT, 0};
+        poll(&fd, 1, TERMINAL_FLUSH_MS);
+        continue;
+      }
+      break;
+    }
+    written += count;
+  }
+  out_buffer.clear();
+}
@@ -0,0 +1,119 @@
+#include "../../inc/emulator/Emulator.hpp"
+
+/*
+  Threaded code dispatch engine
+  Every handler ends by fetching the next decoded instruction and jumping directly to its handler (GCC labels as values),
+  so there is no central loop. Terminal input is polled every TERMINAL_POLL_INTERVAL instructions, and the fast path
+  is left only when an interrupt would be accepted
+*/
+
+#ifdef __GNUC__
+
+void Emulator::runThreaded() {
+
+  uint32_t* gpr = cpu.gpr;
+  uint32_t* csr = cpu.csr;
+  uint64_t* op_counts = counters.ops;
+  uint32_t poll_budget = pollBudget();
+  uint32_t poll_countdown = poll_budget;
+  const DecodedInstr* d;
+
+  #define DISPATCH() \
+    do { \
+      if ( --poll_countdown == 0 ) { \
+        advanceTime(poll_budget); \
+        if ( retired >= run_limit ) return; \
+        handleTerminal(); \
+        armIdle(); \
+        pollRequests(); \
+        poll_countdown = poll_budget = pollBudget(); \
+      } \
+      if ( cpu.interruptPending() ) goto interrupt; \
+      d = &fetchInstruction(); \
+      op_counts[d->op]++; \
+      if ( instrumented ) instrument(gpr[PC] - 4, *d); \
+      goto *handlers[d->op]; \
+    } while(0)
+
+  #define STORE(addr) \
+    do { \
+      storeWord(addr, gpr[d->reg_C]); \
+    } while(0)
+
+  // Instructions run since the last poll are accounted for before reading the time
+  // Next poll stays where it was(or comes sooner if a deadline moved closer), syncing on every jump would otherwise
+  // keep putting it off
+  #define SYNC_TIME() \
+    do { \
+      advanceTime(poll_budget - poll_countdown); \
+      poll_countdown = poll_budget = std::min(poll_countdown, pollBudget()); \
+    } while(0)
+
+  // Timer is started only after handler address has been set
+  #define CSR_WRITTEN() \
+    do { \
+      if ( !timer_started && csr[HANDLER] != 0 ) { SYNC_TIME(); startTimer(); SYNC_TIME(); } \
+    } while(0)
+
+  // Halt isn't followed by a dispatch, so it is counted here as it is by the switch loop
+  #define HALT() do { poll_countdown--; SYNC_TIME(); halted = true; return; } while(0)
+
+  // Waits and idle checks can skip ahead to a deadline or the end of the run, so the current instruction is counted
+  // before them and the run stops right there if it is over. Its dispatch counts it again, which the extra countdown
+  // makes up for
+  #define COUNT_CURRENT() do { poll_countdown--; SYNC_TIME(); } while(0)
+  #define RESUME() \
+    do { \
+      SYNC_TIME(); \
+      if ( retired >= run_limit ) return; \
+      poll_countdown++; \
+    } while(0)
+
+  // Deadline can move while waiting, so the budget is taken again afterwards
+  #define WAIT() do { COUNT_CURRENT(); waitForInterrupt(); RESUME(); } while(0)
+
+  // Idle wait can skip time or sleep, so time is synced around it like around wait for interrupt
+  #define JUMPED() \
+    do { \
+      if ( idle_state ) { COUNT_CURRENT(); checkIdle(gpr[PC]); RESUME(); } \
+    } while(0)
+
+  // Pair is split when it would run past the poll, so time is exact there
+  #define PAIRED() ( poll_countdown > 1 && --poll_countdown )
+
+  goto start;
+
+  #include "OpHandlers.inc"
+
+  // Blocks are never executed by this engine
+op_block_end:
+  goto op_invalid;
+
+interrupt:
+  checkInterrupts();
+start:
+  d = &fetchInstruction();
+  op_counts[d->op]++;
+  if ( instrumented ) instrument(gpr[PC] - 4, *d);
+  goto *handlers[d->op];
+
+  #undef DISPATCH
+  #undef STORE
+  #undef CSR_WRITTEN
+  #undef HALT
+  #undef WAIT
+  #undef SYNC_TIME
+  #undef COUNT_CURRENT
+  #undef RESUME
+  #undef JUMPED
+  #undef PAIRED
+}
+
+#else
+
+// Labels as values are not available, threaded engine falls back to the switch loop
+void Emulator::runThreaded() {
+  runSwitch();
+}
+
+#endif
@@ -0,0 +1,318 @@
+#include "../../inc/emulator/Trace.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+static void putLength(std::vector<uint8_t>& out, uint32_t length) {
+  while ( length >= 255 ) {
+    out.push_back(255);
+    length -= 255;
+  }
+  out.push_back(length);
+}
+
+static void putSequence(std::vector<uint8_t>& out, const uint8_t* literals, uint32_t literal_count, uint32_t offset, uint32_t match) {
+  uint32_t match_code = match ? match - 4 : 0;
+  out.push_back((std::min(literal_count, 15u) << 4) | std::min(match_code, 15u));
+  if ( literal_count >= 15 ) putLength(out, literal_count - 15);
+  out.insert(out.end(), literals, literals + literal_count);
+  if ( !match ) return;
+
+  out.push_back(offset & 0xff);
+  out.push_back(offset >> 8);
+  if ( match_code >= 15 ) putLength(out, match_code - 15);
+}
+
+void TraceCompression::compress(const uint8_t* in, uint32_t size, std::vector<uint8_t>& out) {
+  std::vector<uint32_t> table(1u << TRACE_HASH_BITS, UINT32_MAX);
+  uint32_t position = 0;
+  uint32_t literal_start = 0;
+
+  while ( position + 4 <= size ) {
+    uint32_t sequence;
+    memcpy(&sequence, in + position, 4);
+    uint32_t hash = (sequence * 2654435761u) >> (32 - TRACE_HASH_BITS);
+    uint32_t candidate = table[hash];
+    table[hash] = position;
+
+    if ( candidate == UINT32_MAX || position - candidate > 0xffff || memcmp(in + candidate, in + position, 4) ) {
+      position++;
+      continue;
+    }
+
+    uint32_t match = 4;
+    while ( position + match < size && in[candidate + match] == in[position + match] ) match++;
+    putSequence(out, in + literal_start, position - literal_start, position - candidate, match);
+    position += match;
+    literal_start = position;
+  }
+
+  putSequence(out, in + literal_start, size - literal_start, 0, 0);
+}
+
+bool TraceCompression::decompress(const uint8_t* in, uint32_t size, std::vector<uint8_t>& out, uint32_t raw_size) {
+  const uint8_t* end = in + size;
+  out.clear();
+  out.reserve(raw_size);
+
+  // Length continues in extra bytes when its nibble is 15
+  auto getLength = [&](uint32_t length) {
+    if ( length != 15 ) return length;
+    while ( in < end ) {
+      uint8_t extra = *in++;
+      length += extra;
+      if ( extra != 255 ) break;
+    }
+    return length;
+  };
+
+  while ( in < end ) {
+    uint8_t token = *in++;
+    uint32_t literal_count = getLength(token >> 4);
+    if ( literal_count > (uint32_t)(end - in) || out.size() + literal_count > raw_size ) return false;
+    out.insert(out.end(), in, in + literal_count);
+    in += literal_count;
+    if ( in == end ) break;
+
+    if ( end - in < 2 ) return false;
+    uint32_t offset = in[0] | (in[1] << 8);
+    in += 2;
+    uint32_t match = getLength(token & 0xf) + 4;
+    if ( offset == 0 || offset > out.size() || out.size() + match > raw_size ) return false;
+    // Match can overlap the bytes it produces, so it is copied one byte at a time
+    size_t from = out.size() - offset;
+    for ( uint32_t i = 0; i < match; i++ ) out.push_back(out[from + i]);
+  }
+
+  return out.size() == raw_size;
+}
+
+
+static uint8_t* putVarint(uint8_t* out, uint32_t value) {
+  while ( value >= 0x80 ) {
+    *out++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *out++ = value;
+  return out;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+bool TraceWriter::open(std::string file_name) {
+  fout.open(file_name, std::ios::binary | std::ios::trunc);
+  if ( !fout.is_open() ) return false;
+
+  uint64_t magic = TRACE_MAGIC;
+  uint32_t version = TRACE_VERSION;
+  fout.write((const char*)&magic, sizeof(magic));
+  fout.write((const char*)&version, sizeof(version));
+  written_bytes = sizeof(magic) + sizeof(version);
+
+  for ( std::vector<uint8_t>& chunk : chunks ) chunk.reserve(TRACE_CHUNK_SIZE + TRACE_RECORD_MAX);
+  writer = new std::thread(&TraceWriter::writerBody, this);
+  return true;
+}
+
+void TraceWriter::writeRecord(const uint32_t* gpr) {
+  uint8_t record[TRACE_RECORD_MAX];
+  uint8_t* out = record + 1;
+  uint8_t flags = 0;
+
+  if ( pending_pc != expected_pc ) {
+    flags |= TRACE_JUMP;
+    out = putVarint(out, zigzag(pending_pc - expected_pc));
+  }
+  expected_pc = pending_pc + 4;
+
+  // Cache has one entry per aligned word while reader keeps words by exact address, so words at unaligned addresses
+  // are always written and never cached
+  WordPage& page = *words.get(pending_pc);
+  uint32_t index = (pending_pc & PAGE_MASK) >> 2;
+  bool aligned = (pending_pc & 3) == 0;
+  if ( !aligned || !page.seen[index] || page.words[index] != pending_word ) {
+    flags |= TRACE_WORD;
+    memcpy(out, &pending_word, 4);
+    out += 4;
+    if ( aligned ) {
+      page.seen[index] = 1;
+      page.words[index] = pending_word;
+    }
+  }
+
+  if ( pending_interrupt >= 0 ) {
+    flags |= TRACE_INTERRUPT;
+    *out++ = pending_interrupt;
+    pending_interrupt = -1;
+  }
+
+  uint32_t written = 0;
+  for ( int i = 0; i < PC; i++ ) {
+    if ( gpr[i] != regs[i] ) written |= 1u << i;
+  }
+  if ( written ) {
+    flags |= TRACE_REGS;
+    out = putVarint(out, written);
+    for ( int i = 0; i < PC; i++ ) {
+      if ( !(written & (1u << i)) ) continue;
+      out = putVarint(out, zigzag(gpr[i] - regs[i]));
+      regs[i] = gpr[i];
+    }
+  }
+
+  record[0] = flags;
+  std::vector<uint8_t>& chunk = chunks[filled.load(std::memory_order_relaxed) % TRACE_CHUNKS];
+  chunk.insert(chunk.end(), record, out);
+  records++;
+  raw_bytes += out - record;
+  if ( chunk.size() >= TRACE_CHUNK_SIZE ) publish();
+}
+
+// Hands the current chunk to the writer, and waits if the next one hasn't been written out yet
+void TraceWriter::publish() {
+  std::unique_lock<std::mutex> lock(ring_mutex);
+  filled.fetch_add(1, std::memory_order_release);
+  ring_cv.notify_all();
+  ring_cv.wait(lock, [this] { return filled.load() - drained.load() < TRACE_CHUNKS; });
+}
+
+void TraceWriter::writerBody() {
+  std::vector<uint8_t> compressed;
+
+  while ( true ) {
+    {
+      std::unique_lock<std::mutex> lock(ring_mutex);
+      ring_cv.wait(lock, [this] { return drained.load() < filled.load() || finished; });
+      if ( drained.load() == filled.load() ) break;
+    }
+
+    std::vector<uint8_t>& chunk = chunks[drained.load() % TRACE_CHUNKS];
+    compressed.clear();
+    TraceCompression::compress(chunk.data(), chunk.size(), compressed);
+    uint32_t sizes[2] = { (uint32_t)chunk.size(), (uint32_t)compressed.size() };
+    fout.write((const char*)sizes, sizeof(sizes));
+    fout.write((const char*)compressed.data(), compressed.size());
+    written_bytes += sizeof(sizes) + compressed.size();
+    chunk.clear();
+
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    drained.fetch_add(1, std::memory_order_release);
+    ring_cv.notify_all();
+  }
+}
+
+void TraceWriter::finish(const uint32_t* gpr) {
+  if ( !writer ) return;
+
+  if ( pending && gpr ) writeRecord(gpr);
+  pending = false;
+  if ( !chunks[filled.load() % TRACE_CHUNKS].empty() ) publish();
+
+  {
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    finished = true;
+  }
+  ring_cv.notify_all();
+  writer->join();
+  delete writer;
+  writer = nullptr;
+  fout.close();
+}
+
+
+bool TraceReader::open(std::string file_name) {
+  fin.open(file_name, std::ios::binary);
+  if ( !fin.is_open() ) return false;
+
+  uint64_t magic = 0;
+  uint32_t version = 0;
+  fin.read((char*)&magic, sizeof(magic));
+  fin.read((char*)&version, sizeof(version));
+  return fin && magic == TRACE_MAGIC && version == TRACE_VERSION;
+}
+
+bool TraceReader::readChunk() {
+  uint32_t sizes[2];
+  if ( !fin.read((char*)sizes, sizeof(sizes)) ) return false;
+
+  std::vector<uint8_t> compressed(sizes[1]);
+  if ( !fin.read((char*)compressed.data(), compressed.size())
+    || !TraceCompression::decompress(compressed.data(), compressed.size(), chunk, sizes[0]) ) {
+    damaged = true;
+    return false;
+  }
+  position = 0;
+  return true;
+}
+
+bool TraceReader::readVarint(uint32_t& value) {
+  value = 0;
+  for ( int shift = 0; shift < 35; shift += 7 ) {
+    if ( position >= chunk.size() ) break;
+    uint8_t byte = chunk[position++];
+    value |= (uint32_t)(byte & 0x7f) << shift;
+    if ( !(byte & 0x80) ) return true;
+  }
+  damaged = true;
+  return false;
+}
+
+bool TraceReader::next(TraceRecord& record) {
+  while ( position >= chunk.size() ) {
+    if ( !readChunk() ) return false;
+  }
+
+  uint8_t flags = chunk[position++];
+  uint32_t value;
+
+  record.pc = expected_pc;
+  if ( flags & TRACE_JUMP ) {
+    if ( !readVarint(value) ) return false;
+    record.pc += unzigzag(value);
+  }
+  expected_pc = record.pc + 4;
+
+  if ( flags & TRACE_WORD ) {
+    if ( position + 4 > chunk.size() ) {
+      damaged = true;
+      return false;
+    }
+    memcpy(&words[record.pc], chunk.data() + position, 4);
+    position += 4;
+  }
+  auto word = words.find(record.pc);
+  if ( word == words.end() ) {
+    damaged = true;
+    return false;
+  }
+  record.word = word->second;
+
+  record.interrupt = -1;
+  if ( flags & TRACE_INTERRUPT ) {
+    if ( position >= chunk.size() ) {
+      damaged = true;
+      return false;
+    }
+    record.interrupt = chunk[position++];
+  }
+
+  record.written = 0;
+  if ( flags & TRACE_REGS ) {
+    if ( !readVarint(record.written) ) return false;
+    for ( int i = 0; i < PC; i++ ) {
+      if ( !(record.written & (1u << i)) ) continue;
+      if ( !readVarint(value) ) return false;
+      regs[i] += unzigzag(value);
+    }
+  }
+
+  std::copy(regs, regs + GPR_CNT, record.gpr);
+  record.gpr[PC] = record.pc;
+  return true;
+}
@@ -0,0 +1,202 @@
+#include "../../inc/emulator/X86Emitter.hpp"
+
+void X86Emitter::rex(bool w, int reg, int index, int base) {
+  uint8_t prefix = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+  if ( prefix != 0x40 ) byte(prefix);
+}
+
+// [base + disp32], RSP and R12 as base can only be encoded with SIB byte
+void X86Emitter::modrmMem(int reg, int base, int32_t disp) {
+  if ( (base & 7) == RSP ) {
+    byte(0x84 | (reg & 7) << 3);
+    byte(0x24);
+  } else {
+    byte(0x80 | (reg & 7) << 3 | (base & 7));
+  }
+  dword(disp);
+}
+
+// [base + index * (1 << scale)], disp8 of 0 is used so RBP and R13 can be the base
+void X86Emitter::modrmIndex(int reg, int base, int index, int scale) {
+  byte(0x44 | (reg & 7) << 3);
+  byte(scale << 6 | (index & 7) << 3 | (base & 7));
+  byte(0);
+}
+
+void X86Emitter::mov(int dst, int src) {
+  rex(false, src, 0, dst);
+  byte(0x89);
+  modrmReg(src, dst);
+}
+
+void X86Emitter::mov64(int dst, int src) {
+  rex(true, src, 0, dst);
+  byte(0x89);
+  modrmReg(src, dst);
+}
+
+void X86Emitter::movImm(int dst, uint32_t imm) {
+  rex(false, 0, 0, dst);
+  byte(0xb8 + (dst & 7));
+  dword(imm);
+}
+
+void X86Emitter::movImm64(int dst, uint64_t imm) {
+  rex(true, 0, 0, dst);
+  byte(0xb8 + (dst & 7));
+  qword(imm);
+}
+
+void X86Emitter::load(int dst, int base, int32_t disp) {
+  rex(false, dst, 0, base);
+  byte(0x8b);
+  modrmMem(dst, base, disp);
+}
+
+void X86Emitter::store(int base, int32_t disp, int src) {
+  rex(false, src, 0, base);
+  byte(0x89);
+  modrmMem(src, base, disp);
+}
+
+void X86Emitter::storeImm(int base, int32_t disp, uint32_t imm) {
+  rex(false, 0, 0, base);
+  byte(0xc7);
+  modrmMem(0, base, disp);
+  dword(imm);
+}
+
+void X86Emitter::loadIndex(int dst, int base, int index) {
+  rex(false, dst, index, base);
+  byte(0x8b);
+  modrmIndex(dst, base, index, 0);
+}
+
+void X86Emitter::storeIndex(int base, int index, int src) {
+  rex(false, src, index, base);
+  byte(0x89);
+  modrmIndex(src, base, index, 0);
+}
+
+void X86Emitter::load64Index8(int dst, int base, int index) {
+  rex(true, dst, index, base);
+  byte(0x8b);
+  modrmIndex(dst, base, index, 3);
+}
+
+void X86Emitter::cmpByteIndexZero(int base, int index) {
+  rex(false, 0, index, base);
+  byte(0x80);
+  modrmIndex(7, base, index, 0);
+  byte(0);
+}
+
+void X86Emitter::storeByteIndexOne(int base, int index) {
+  rex(false, 0, index, base);
+  byte(0xc6);
+  modrmIndex(0, base, index, 0);
+  byte(1);
+}
+
+void X86Emitter::alu(uint8_t opcode, int dst, int src) {
+  rex(false, src, 0, dst);
+  byte(opcode);
+  modrmReg(src, dst);
+}
+
+void X86Emitter::aluImm(int ext, int dst, uint32_t imm) {
+  rex(false, 0, 0, dst);
+  byte(0x81);
+  modrmReg(ext, dst);
+  dword(imm);
+}
+
+void X86Emitter::imul(int dst, int src) {
+  rex(false, dst, 0, src);
+  byte(0x0f);
+  byte(0xaf);
+  modrmReg(dst, src);
+}
+
+void X86Emitter::notr(int reg) {
+  rex(false, 0, 0, reg);
+  byte(0xf7);
+  modrmReg(2, reg);
+}
+
+void X86Emitter::shift(int ext, int reg) {
+  rex(false, 0, 0, reg);
+  byte(0xd3);
+  modrmReg(ext, reg);
+}
+
+void X86Emitter::shrImm(int reg, uint8_t imm) {
+  rex(false, 0, 0, reg);
+  byte(0xc1);
+  modrmReg(5, reg);
+  byte(imm);
+}
+
+void X86Emitter::idiv(int reg) {
+  rex(false, 0, 0, reg);
+  byte(0xf7);
+  modrmReg(7, reg);
+}
+
+void X86Emitter::test64(int a, int b) {
+  rex(true, b, 0, a);
+  byte(0x85);
+  modrmReg(b, a);
+}
+
+size_t X86Emitter::jcc(int cond) {
+  byte(0x0f);
+  byte(0x80 | cond);
+  size_t at = pos;
+  dword(0);
+  return at;
+}
+
+size_t X86Emitter::jmp() {
+  byte(0xe9);
+  size_t at = pos;
+  dword(0);
+  return at;
+}
+
+void X86Emitter::patch(size_t at) {
+  uint32_t rel = pos - (at + 4);
+  for ( int i = 0; i < 4; i++ ) {
+    if ( at + i < capacity ) buffer[at + i] = rel >> 8 * i;
+  }
+}
+
+void X86Emitter::call(int reg) {
+  rex(false, 0, 0, reg);
+  byte(0xff);
+  modrmReg(2, reg);
+}
+
+void X86Emitter::push(int reg) {
+  rex(false, 0, 0, reg);
+  byte(0x50 + (reg & 7));
+}
+
+void X86Emitter::pop(int reg) {
+  rex(false, 0, 0, reg);
+  byte(0x58 + (reg & 7));
+}
+
+void X86Emitter::subRsp(uint8_t imm) {
+  byte(0x48);
+  byte(0x83);
+  byte(0xec);
+  byte(imm);
+}
+
+void X86Emitter::addRsp(uint8_t imm) {
+  byte(0x48);
+  byte(0x83);
+  byte(0xc4);
+  byte(imm);
+}
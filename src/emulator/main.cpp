@@ -1,21 +1,183 @@
 #include "../../inc/emulator/Emulator.hpp"
+#include "../../inc/emulator/BatchRunner.hpp"
 
 #include <iostream>
 
 
 int main(int argc, char* argv[]) {
-  if ( argc != 2 ) {
-    std::cout << "usage: emulator <input-file>" << std::endl;
+  std::string usage = "usage: emulator [options] <input-file>|-load-snapshot=<file>|-batch=<job-list> \
+      \n\noptions:\n -engine=<switch|threaded|block|jit>\n -jit-lockstep\n -timer=<real|virtual>\n -timer-rate=<instructions-per-ms>\n -no-idle-skip\n -no-loop-idioms\n -host-dir=<directory>\n -headless\n -input=<file|->\n -input-interval=<instructions>|<milliseconds>ms\n -output=<file>\n -save-snapshot=<file>\n -load-snapshot=<file>\n -fuzz=<input-directory>\n -fuzz-limit=<instructions>\n -jobs=<workers>\n -batch-limit=<instructions>\n -profile=<file>\n -callgraph=<file>\n -trace=<file>\n -sample=<file>\n -sample-interval=<microseconds>\n -stats=<file>";
+
+  Emulator* emulator = new Emulator();
+  std::string file_name = "";
+  // Snapshot replaces the input file
+  std::string snapshot_name = "";
+  bool virtual_timer = false;
+  bool fuzz = false;
+  // Guest can read host files only if it was given a directory
+  bool host_dir = false;
+  // Batch mode runs every job from the list on its own machine, with the options given here
+  std::string batch_list = "";
+  unsigned jobs = std::thread::hardware_concurrency();
+  uint64_t batch_limit = BATCH_LIMIT;
+  // Programs built with translated blocks only use them in the block engines
+  if ( !AotRuntime::empty() ) emulator->setEngine(ENGINE_BLOCK);
+
+  for ( int i = 1; i < argc; i++) {
+    std::string temp = argv[i];
+    if ( temp.substr(0, 8) == "-engine=" ) {
+      temp = temp.substr(8);
+      if ( temp == "switch" ) emulator->setEngine(ENGINE_SWITCH);
+      else if ( temp == "threaded" ) emulator->setEngine(ENGINE_THREADED);
+      else if ( temp == "block" ) emulator->setEngine(ENGINE_BLOCK);
+      else if ( temp == "jit" ) emulator->setEngine(ENGINE_JIT);
+      else {
+        std::cout << usage << std::endl;
+        exit(-1);
+      }
+    } else if ( temp == "-jit-lockstep" ) {
+      emulator->setJitLockstep(true);
+    } else if ( temp.substr(0, 7) == "-timer=" ) {
+      temp = temp.substr(7);
+      if ( temp == "real" ) virtual_timer = false;
+      else if ( temp == "virtual" ) virtual_timer = true;
+      else {
+        std::cout << usage << std::endl;
+        exit(-1);
+      }
+    } else if ( temp.substr(0, 12) == "-timer-rate=" ) {
+      temp = temp.substr(12);
+      char* end;
+      unsigned long rate = std::strtoul(temp.c_str(), &end, 10);
+      if ( temp == "" || *end != '\0' || rate == 0 ) {
+        std::cout << usage << std::endl;
+        exit(-1);
+      }
+      emulator->setTimerRate(rate);
+    } else if ( temp == "-no-idle-skip" ) {
+      emulator->setIdleSkip(false);
+    } else if ( temp == "-no-loop-idioms" ) {
+      emulator->setLoopIdioms(false);
+    } else if ( temp.substr(0, 10) == "-host-dir=" && temp.size() > 10 ) {
+      emulator->setHostDir(temp.substr(10));
+      host_dir = true;
+    } else if ( temp == "-headless" ) {
+      emulator->setHeadless(true);
+    } else if ( temp.substr(0, 7) == "-input=" && temp.size() > 7 ) {
+      emulator->setInputFile(temp.substr(7));
+    } else if ( temp.substr(0, 8) == "-output=" && temp.size() > 8 ) {
+      emulator->setOutputFile(temp.substr(8));
+    } else if ( temp.substr(0, 16) == "-input-interval=" ) {
+      temp = temp.substr(16);
+      bool in_ms = temp.size() > 2 && temp.substr(temp.size() - 2) == "ms";
+      if ( in_ms ) temp = temp.substr(0, temp.size() - 2);
+      char* end;
+      unsigned long long interval = std::strtoull(temp.c_str(), &end, 10);
+      if ( temp == "" || *end != '\0' ) {
+        std::cout << usage << std::endl;
+        exit(-1);
+      }
+      emulator->setInputInterval(interval, in_ms);
+    } else if ( temp.substr(0, 15) == "-save-snapshot=" && temp.size() > 15 ) {
+      emulator->setSaveSnapshot(temp.substr(15));
+    } else if ( temp.substr(0, 15) == "-load-snapshot=" && temp.size() > 15 ) {
+      snapshot_name = temp.substr(15);
+      emulator->setLoadSnapshot(snapshot_name);
+    } else if ( temp.substr(0, 6) == "-fuzz=" && temp.size() > 6 ) {
+      emulator->setFuzzDir(temp.substr(6));
+      fuzz = true;
+    } else if ( temp.substr(0, 12) == "-fuzz-limit=" ) {
+      temp = temp.substr(12);
+      char* end;
+      unsigned long long limit = std::strtoull(temp.c_str(), &end, 10);
+      if ( temp == "" || *end != '\0' || limit == 0 ) {
+        std::cout << usage << std::endl;
+        exit(-1);
+      }
+      emulator->setFuzzLimit(limit);
+    } else if ( temp.substr(0, 9) == "-profile=" && temp.size() > 9 ) {
+      emulator->setProfileFile(temp.substr(9));
+    } else if ( temp.substr(0, 11) == "-callgraph=" && temp.size() > 11 ) {
+      emulator->setCallGraphFile(temp.substr(11));
+    } else if ( temp.substr(0, 7) == "-trace=" && temp.size() > 7 ) {
+      emulator->setTraceFile(temp.substr(7));
+    } else if ( temp.substr(0, 8) == "-sample=" && temp.size() > 8 ) {
+      emulator->setSampleFile(temp.substr(8));
+    } else if ( temp.substr(0, 17) == "-sample-interval=" ) {
+      temp = temp.substr(17);
+      char* end;
+      unsigned long interval = std::strtoul(temp.c_str(), &end, 10);
+      if ( temp == "" || *end != '\0' || interval == 0 ) {
+        std::cout << usage << std::endl;
+        exit(-1);
+      }
+      emulator->setSampleInterval(interval);
+    } else if ( temp.substr(0, 7) == "-stats=" && temp.size() > 7 ) {
+      emulator->setStatsFile(temp.substr(7));
+    } else if ( temp.substr(0, 7) == "-batch=" && temp.size() > 7 ) {
+      batch_list = temp.substr(7);
+    } else if ( temp.substr(0, 6) == "-jobs=" ) {
+      temp = temp.substr(6);
+      char* end;
+      unsigned long count = std::strtoul(temp.c_str(), &end, 10);
+      if ( temp == "" || *end != '\0' || count == 0 ) {
+        std::cout << usage << std::endl;
+        exit(-1);
+      }
+      jobs = count;
+    } else if ( temp.substr(0, 13) == "-batch-limit=" ) {
+      temp = temp.substr(13);
+      char* end;
+      unsigned long long limit = std::strtoull(temp.c_str(), &end, 10);
+      if ( temp == "" || *end != '\0' || limit == 0 ) {
+        std::cout << usage << std::endl;
+        exit(-1);
+      }
+      batch_limit = limit;
+    } else if ( file_name == "" && temp[0] != '-' ) {
+      file_name = temp;
+    } else {
+      std::cout << usage << std::endl;
+      exit(-1);
+    }
+  }
+
+  // Fuzz inputs are untrusted, they never get to host files
+  if ( fuzz && host_dir ) {
+    std::cout << usage << std::endl;
     exit(-1);
   }
 
-  Emulator* emulator = Emulator::getInstance();
+  // Runs have to be repeatable, so fuzzing always uses virtual time
+  emulator->setVirtualTimer(virtual_timer || fuzz);
+  // Running machines write their counters to stderr on SIGUSR1
+  Emulator::installStatsSignal();
+
+  if ( batch_list != "" ) {
+    if ( file_name != "" || snapshot_name != "" || fuzz ) {
+      std::cout << usage << std::endl;
+      exit(-1);
+    }
+    if ( jobs == 0 ) jobs = 1;
+
+    auto start = std::chrono::steady_clock::now();
+    BatchRunner runner(*emulator, jobs, batch_limit);
+    runner.readJobs(batch_list);
+    runner.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    runner.printResults(elapsed.count());
+    return 0;
+  }
+
+  if ( (file_name == "") == (snapshot_name == "") ) {
+    std::cout << usage << std::endl;
+    exit(-1);
+  }
+  emulator->setFileName(file_name);
 
-  emulator->setFileName((std::string)argv[1]);
-  
   emulator->startEmulating();
 
-  std::remove(argv[1]);
+  if ( file_name != "" ) std::remove(file_name.c_str());
 
   return 0;
-}
\ No newline at end of file
+}
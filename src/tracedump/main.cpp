@@ -0,0 +1,66 @@
+#include "../../inc/emulator/Trace.hpp"
+#include "../../inc/Helper.hpp"
+
+#include <iostream>
+
+
+int main(int argc, char* argv[]) {
+  std::string usage = "usage: tracedump [options] <trace-file> \
+      \n\noptions:\n -summary";
+
+  std::string file_name = "";
+  bool summary = false;
+
+  for ( int i = 1; i < argc; i++) {
+    std::string temp = argv[i];
+    if ( temp == "-summary" ) {
+      summary = true;
+    } else if ( file_name == "" && temp[0] != '-' ) {
+      file_name = temp;
+    } else {
+      std::cout << usage << std::endl;
+      exit(-1);
+    }
+  }
+
+  if ( file_name == "" ) {
+    std::cout << usage << std::endl;
+    exit(-1);
+  }
+
+  TraceReader reader;
+  if ( !reader.open(file_name) ) {
+    std::cout << "tracedump: error : file '" + file_name + "' is not an instruction trace" << std::endl;
+    exit(-1);
+  }
+
+  // Every line is address, instruction word and the registers it wrote, followed by the interrupt entered after it
+  TraceRecord record;
+  uint64_t instructions = 0;
+  uint64_t interrupts = 0;
+  while ( reader.next(record) ) {
+    instructions++;
+    if ( record.interrupt >= 0 ) interrupts++;
+    if ( summary ) continue;
+
+    Helper::printHex(std::cout, record.pc, 10, true);
+    std::cout << "   ";
+    Helper::printHex(std::cout, record.word, 10, true);
+    for ( int i = 0; i < PC; i++ ) {
+      if ( !(record.written & (1u << i)) ) continue;
+      std::cout << "   r" << i << "=";
+      Helper::printHex(std::cout, record.gpr[i], 10, true);
+    }
+    if ( record.interrupt >= 0 ) std::cout << "   interrupt(cause " << record.interrupt + 1 << ")";
+    std::cout << '\n';
+  }
+
+  if ( reader.isDamaged() ) {
+    std::cout << "tracedump: error : trace is damaged after " << instructions << " instructions" << std::endl;
+    exit(-1);
+  }
+
+  std::cout << "Trace: " << instructions << " instructions, " << interrupts << " interrupts" << std::endl;
+
+  return 0;
+}
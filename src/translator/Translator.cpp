@@ -0,0 +1,288 @@
+#include "../../inc/translator/Translator.hpp"
+#include "../../inc/emulator/Emulator.hpp"
+
+Translator* Translator::translator = nullptr;
+
+Translator* Translator::getInstance() {
+  if ( translator == nullptr ) {
+    translator = new Translator();
+  }
+
+  return translator;
+}
+
+static std::string hex(uint32_t value) {
+  std::ostringstream os;
+  Helper::printHex(os, value, 10, true);
+  return os.str() + "u";
+}
+
+void Translator::startTranslating() {
+  loadSegments();
+  findBlocks();
+  writeOutput();
+}
+
+void Translator::loadSegments() {
+  Elf32File file(file_name, 0, true);
+  file.readFromFile();
+
+  if ( file.getType() != ET_EXEC ) {
+    printError("file '" + file_name + "' is not executable");
+  }
+
+  for ( uint32_t i = 0; i < file.getNumberOfSegments(); i++ ) {
+    Elf32_Phdr* header = file.getSegmentHeader(i);
+    std::vector<uint8_t>& contents_ref = *file.getSegmentContents(i);
+
+    if ( header->p_type != PT_LOAD ) continue;
+
+    for ( size_t j = 0; j < contents_ref.size(); j++ ) {
+      memory.write(header->p_vaddr + j, contents_ref[j]);
+    }
+    segments.push_back(std::make_pair(header->p_vaddr, header->p_vaddr + (uint32_t)contents_ref.size()));
+  }
+}
+
+bool Translator::inSegment(uint32_t address) const {
+  for ( auto& segment : segments ) {
+    if ( address >= segment.first && address < segment.second ) return true;
+  }
+  return false;
+}
+
+void Translator::addCandidate(uint32_t address) {
+  if ( (address & 3) || !inSegment(address) ) return;
+  if ( found.insert(address).second ) worklist.push_back(address);
+}
+
+void Translator::findBlocks() {
+  addCandidate(START_ADDR);
+  for ( auto& segment : segments ) {
+    for ( uint32_t address = segment.first; address + 4 <= segment.second; address += 4 ) {
+      addCandidate(memory.readWord(address));
+    }
+  }
+
+  while ( !worklist.empty() ) {
+    uint32_t pc = worklist.back();
+    worklist.pop_back();
+
+    Block* block = block_cache.get(memory, pc);
+    blocks.push_back(block);
+
+    const DecodedInstr& last = block->ops[block->size - 1];
+    // Targets are known only for PC relative jumps, or jumps through a literal pool
+    uint32_t target_base = last.reg_A == PC ? block->end : 0;
+    switch (last.op) {
+      case OP_HALT:
+        break;
+      case OP_JMP:
+        if ( last.reg_A == PC ) addCandidate(target_base + last.disp);
+        break;
+      case OP_JMP_MEM:
+        if ( last.reg_A == PC ) addCandidate(memory.readWord(target_base + last.disp));
+        break;
+      case OP_BEQ: case OP_BNE: case OP_BGT:
+      case OP_BEQ_MEM: case OP_BNE_MEM: case OP_BGT_MEM:
+        if ( last.reg_A == PC ) addCandidate(target_base + last.disp);
+        addCandidate(block->end);
+        break;
+      case OP_CALL:
+        if ( last.reg_A == PC && last.reg_B == 0 ) addCandidate(target_base + last.disp);
+        addCandidate(block->end);
+        break;
+      case OP_CALL_MEM:
+        if ( last.reg_A == PC && last.reg_B == 0 ) addCandidate(memory.readWord(target_base + last.disp));
+        addCandidate(block->end);
+        break;
+      default:
+        // Block ended because of its length, page boundary or a CSR write, or it wrote to PC
+        addCandidate(block->end);
+        break;
+    }
+  }
+}
+
+void Translator::writeOutput() {
+  if ( output_name == "" ) output_name = "output.cpp";
+
+  std::ostringstream functions;
+  std::ostringstream table;
+
+  for ( Block* block : blocks ) {
+    std::ostringstream code;
+    if ( !translateBlock(code, *block) ) {
+      rejected++;
+      continue;
+    }
+    translated++;
+
+    // Second word of IRET is decoded together with the first, so it has to match as well
+    uint32_t length = block->size;
+    if ( block->ops[block->size - 1].op == OP_IRET ) length++;
+
+    std::string name = hex(block->start);
+    name = name.substr(2, 8);
+
+    functions << "static const uint32_t words_" << name << "[] = {";
+    for ( uint32_t i = 0; i < length; i++ ) {
+      functions << ( i % 6 == 0 ? "\n  " : " " ) << hex(memory.readWord(block->start + i * 4)) << ",";
+    }
+    functions << "\n};\n\n";
+    functions << "static uint32_t block_" << name << "(uint32_t* gpr, void* context) {\n";
+    functions << code.str();
+    functions << "}\n\n";
+
+    table << "  {" << hex(block->start) << ", " << block->size << ", " << length << ", words_" << name << ", block_" << name << "},\n";
+  }
+
+  std::ofstream fout(output_name);
+  if ( !fout.is_open() ) {
+    printError("could not open file '" + output_name + "'");
+  }
+
+  fout << "// Translated from '" << file_name << "', " << translated << " blocks(" << rejected << " left to the interpreter)\n";
+  fout << "// Build together with the emulator sources, resulting emulator runs translated blocks natively\n\n";
+  fout << "#include \"emulator/AotRuntime.hpp\"\n\n";
+  fout << functions.str();
+  fout << "static const AotBlock aot_blocks[] = {\n";
+  fout << table.str();
+  fout << "};\n\n";
+  fout << "static AotRegistration aot_registration(aot_blocks, " << translated << ");\n";
+
+  fout.close();
+}
+
+bool Translator::translateBlock(std::ostream& os, const Block& block) {
+  bool uses_csr = false;
+  for ( uint32_t i = 0; i < block.size; i++ ) {
+    if ( block.ops[i].op == OP_CSRRD ) uses_csr = true;
+  }
+  // IRET writes STATUS, which needs the emulator to unmask interrupts
+  if ( block.ops[block.size - 1].op == OP_IRET ) return false;
+
+  // CSRs are right after general purpose registers in CPU
+  if ( uses_csr ) os << "  uint32_t* csr = gpr + " << GPR_CNT << ";\n";
+
+  uint32_t pc = block.start;
+  for ( uint32_t i = 0; i < block.size; i++ ) {
+    pc += 4;
+    if ( !translateInstruction(os, block.ops[i], pc, i + 1, i == block.size - 1) ) return false;
+  }
+  return true;
+}
+
+/*
+  PC is kept in gpr only at block exits, so inside the block reads of PC are replaced with the address of the next
+  instruction, and before the last instruction PC is set to the block end, which that instruction can change
+*/
+bool Translator::translateInstruction(std::ostream& os, const DecodedInstr& d, uint32_t next_pc, uint32_t retired, bool last) {
+  auto reg = [&](uint8_t r) {
+    if ( r == PC && !last ) return hex(next_pc);
+    return "gpr[" + std::to_string(r) + "]";
+  };
+  auto dst = [&](uint8_t r) {
+    return "gpr[" + std::to_string(r) + "]";
+  };
+  std::string disp = hex(d.disp);
+  // Store which hits translated code leaves the block after that instruction, and returns how many instructions retired
+  std::string leave = last ? "return " + std::to_string(retired) + ";"
+    : "{ gpr[" + std::to_string(PC) + "] = " + hex(next_pc) + "; return " + std::to_string(retired) + "; }";
+
+  std::string a = reg(d.reg_A), b = reg(d.reg_B), c = reg(d.reg_C);
+
+  if ( last ) os << "  gpr[" << PC << "] = " << hex(next_pc) << ";\n";
+
+  switch (d.op) {
+    case OP_CALL: case OP_CALL_MEM: {
+      std::string target = a + " + " + b + " + " + disp;
+      if ( d.op == OP_CALL_MEM ) target = "aotReadWord(context, " + target + ")";
+      os << "  gpr[" << SP << "] -= 4;\n";
+      os << "  uint32_t result = aotWriteWord(context, gpr[" << SP << "], gpr[" << PC << "]) ? " << retired << " : JIT_EXIT_NEXT;\n";
+      os << "  gpr[" << PC << "] = " << target << ";\n";
+      os << "  return result;\n";
+      return true;
+    }
+    case OP_JMP:
+      os << "  gpr[" << PC << "] = " << a << " + " << disp << ";\n";
+      break;
+    case OP_JMP_MEM:
+      os << "  gpr[" << PC << "] = aotReadWord(context, " << a << " + " << disp << ");\n";
+      break;
+    case OP_BEQ: case OP_BEQ_MEM:
+      os << "  if ( " << b << " == " << c << " ) gpr[" << PC << "] = " << a << " + " << disp << ";\n";
+      break;
+    case OP_BNE: case OP_BNE_MEM:
+      os << "  if ( " << b << " != " << c << " ) gpr[" << PC << "] = " << a << " + " << disp << ";\n";
+      break;
+    case OP_BGT: case OP_BGT_MEM:
+      os << "  if ( (int32_t)" << b << " > (int32_t)" << c << " ) gpr[" << PC << "] = " << a << " + " << disp << ";\n";
+      break;
+    case OP_XCHG:
+      os << "  { uint32_t temp = " << b << "; " << dst(d.reg_B) << " = " << c << "; " << dst(d.reg_C) << " = temp; }\n";
+      break;
+    // Arithmetic is done unsigned, which gives the same bits as the emulator's signed operations
+    case OP_ADD:
+      os << "  " << dst(d.reg_A) << " = " << b << " + " << c << ";\n";
+      break;
+    case OP_SUB:
+      os << "  " << dst(d.reg_A) << " = " << b << " - " << c << ";\n";
+      break;
+    case OP_MUL:
+      os << "  " << dst(d.reg_A) << " = " << b << " * " << c << ";\n";
+      break;
+    case OP_DIV:
+      os << "  " << dst(d.reg_A) << " = (int32_t)" << b << " / (int32_t)" << c << ";\n";
+      break;
+    case OP_NOT:
+      os << "  " << dst(d.reg_A) << " = ~" << b << ";\n";
+      break;
+    case OP_AND:
+      os << "  " << dst(d.reg_A) << " = " << b << " & " << c << ";\n";
+      break;
+    case OP_OR:
+      os << "  " << dst(d.reg_A) << " = " << b << " | " << c << ";\n";
+      break;
+    case OP_XOR:
+      os << "  " << dst(d.reg_A) << " = " << b << " ^ " << c << ";\n";
+      break;
+    // Shift amount is masked the way host shift instructions do it
+    case OP_SHL:
+      os << "  " << dst(d.reg_A) << " = " << b << " << (" << c << " & 31);\n";
+      break;
+    case OP_SHR:
+      os << "  " << dst(d.reg_A) << " = " << b << " >> (" << c << " & 31);\n";
+      break;
+    case OP_ST:
+      os << "  if ( aotWriteWord(context, " << a << " + " << b << " + " << disp << ", " << c << ") ) " << leave << "\n";
+      break;
+    case OP_ST_PUSH:
+      os << "  " << dst(d.reg_A) << " += " << disp << ";\n";
+      os << "  if ( aotWriteWord(context, " << dst(d.reg_A) << ", " << c << ") ) " << leave << "\n";
+      break;
+    case OP_ST_MEM:
+      os << "  if ( aotWriteWord(context, aotReadWord(context, " << a << " + " << b << " + " << disp << "), " << c << ") ) " << leave << "\n";
+      break;
+    case OP_CSRRD:
+      if ( d.reg_B >= CSR_CNT ) return false;
+      os << "  " << dst(d.reg_A) << " = csr[" << (int)d.reg_B << "];\n";
+      break;
+    case OP_LD_REG:
+      os << "  " << dst(d.reg_A) << " = " << b << " + " << disp << ";\n";
+      break;
+    case OP_LD_MEM:
+      os << "  " << dst(d.reg_A) << " = aotReadWord(context, " << b << " + " << c << " + " << disp << ");\n";
+      break;
+    case OP_LD_POP:
+      os << "  " << dst(d.reg_A) << " = aotReadWord(context, " << b << ");\n";
+      os << "  " << dst(d.reg_B) << " += " << disp << ";\n";
+      break;
+    // Halt, software interrupts, invalid instructions and CSR writes need the emulator
+    default:
+      return false;
+  }
+
+  if ( last ) os << "  return JIT_EXIT_NEXT;\n";
+  return true;
+}
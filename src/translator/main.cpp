@@ -0,0 +1,41 @@
+#include "../../inc/translator/Translator.hpp"
+
+#include <iostream>
+
+
+int main(int argc, char* argv[]) {
+  std::string usage = "usage: translator [options] <input-file> \
+      \n\noptions:\n -o <output-file-name>";
+
+  Translator* translator = Translator::getInstance();
+  std::string file_name = "";
+
+  for ( int i = 1; i < argc; i++) {
+    std::string temp = argv[i];
+    if ( temp == "-o" ) {
+      if ( i == argc - 1 ) {
+        std::cout << usage << std::endl;
+        exit(-1);
+      } else {
+        translator->setOutputName((std::string)argv[i+1]);
+        i++;
+      }
+    } else if ( file_name == "" && temp[0] != '-' ) {
+      file_name = temp;
+    } else {
+      std::cout << usage << std::endl;
+      exit(-1);
+    }
+  }
+
+  if ( file_name == "" ) {
+    std::cout << usage << std::endl;
+    exit(-1);
+  }
+
+  translator->setFileName(file_name);
+
+  translator->startTranslating();
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+# Boot code sets up the terminal handler and halts, fuzz runs start from that halt with one input file each
+# Handler echoes up to max_echo characters and lets main halt once it gets a newline. Echoed characters are
+# counted in memory, so the count has to be back to 0 when the next input starts
+
+.equ initial_sp, 0xFFFFFEFE
+.equ term_out, 0xFFFFFF00
+.equ term_in, 0xFFFFFF04
+.equ newline, 10
+.equ max_echo, 2
+
+.section code
+my_start:
+    ld $initial_sp, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    halt
+wait:
+    ld done, %r1
+    beq %r1, %r0, wait
+    halt
+
+.section my_handler
+handler:
+    push %r1
+    push %r2
+    csrrd %cause, %r1
+    ld $3, %r2
+    bne %r1, %r2, finish
+    ld term_in, %r1
+    ld $newline, %r2
+    beq %r1, %r2, line_end
+    ld count, %r2
+    ld $max_echo, %r1
+    beq %r1, %r2, finish
+    ld $1, %r1
+    add %r1, %r2
+    st %r2, count
+    ld term_in, %r1
+    st %r1, term_out
+    jmp finish
+line_end:
+    ld $1, %r1
+    st %r1, done
+finish:
+    pop %r2
+    pop %r1
+    iret
+
+.section data
+count:
+.word 0
+done:
+.word 0
+
+.end
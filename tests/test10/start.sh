@@ -0,0 +1,32 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+
+DIR=./tests/test10
+
+${ASSEMBLER} -o main.o ${DIR}/main.s
+${LINKER} -hex \
+  -place=code@0x40000000 \
+  -o program.hex \
+  main.o || exit 1
+
+# First input ends with a newline and halts, the second one never does and runs into the limit
+# Both get their first two characters echoed only if the run before didn't leave its count behind
+cat > expected.txt <<END
+fuzz: line.txt: halted, 0 invalid, 2 bytes of output(hash 0x683af69a)
+fuzz: no_newline.txt: stopped at the limit, 0 invalid, 2 bytes of output(hash 0x58637fda)
+Fuzzing: 2 inputs, 1 stopped at the limit, 0 executed invalid instructions
+END
+
+# Engines poll the terminal at different instructions, so only the outcome of every run is compared
+STATUS=0
+for RUN in switch threaded block jit; do
+  cp program.hex ${RUN}.hex
+  ${EMULATOR} -engine=${RUN} -fuzz=${DIR}/inputs -fuzz-limit=10000 ${RUN}.hex | grep -i "^fuzz" |
+    sed 's/ after [0-9]* instructions//' > ${RUN}.txt
+  diff expected.txt ${RUN}.txt > /dev/null || {
+    echo "fuzz: ${RUN} ended with"; cat ${RUN}.txt; STATUS=1
+  }
+done
+[ ${STATUS} = 0 ] && echo "fuzz: every input ran from the checkpoint on all engines"
+exit ${STATUS}
@@ -0,0 +1,23 @@
+.global checksum
+
+.section sum
+# r10 = checksum of words from r1 up to r3, every word is weighed by its position
+checksum:
+    push %r1
+    push %r4
+    push %r11
+    ld $0, %r10
+    ld $31, %r11
+loop:
+    ld [%r1 + 0], %r4
+    mul %r11, %r10
+    add %r4, %r10
+    ld $4, %r4
+    add %r4, %r1
+    bne %r1, %r3, loop
+    pop %r11
+    pop %r4
+    pop %r1
+    ret
+
+.end
@@ -0,0 +1,20 @@
+.global isr_timer, ticks
+
+.section isr
+# counts timer interrupts
+isr_timer:
+    push %r1
+    push %r2
+    ld ticks, %r1
+    ld $1, %r2
+    add %r2, %r1
+    st %r1, ticks
+    pop %r2
+    pop %r1
+    ret
+
+.section data
+ticks:
+    .word 0
+
+.end
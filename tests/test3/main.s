@@ -0,0 +1,190 @@
+# Copy, fill and compare loops the block engines can run as host memory operations
+# Every result is stored to the results array and loaded to r1-r13 before halt, so runs with and without loop
+# idioms have to end with the same processor state
+
+.extern handler, checksum, ticks, template, template_end
+
+.equ initial_sp, 0xFFFFFEFE
+.equ timer_config, 0xFFFFFF10
+.equ results, 0x10070000
+
+.section code
+my_start:
+    ld $initial_sp, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    ld $results, %r13
+    # every loop moves its addresses by a word
+    ld $4, %r5
+
+    # fill starting at an unaligned address
+    ld $0x10000001, %r1
+    ld $0x10002001, %r3
+    ld $0x11223344, %r4
+fill_unaligned:
+    st %r4, [%r1 + 0]
+    add %r5, %r1
+    bne %r1, %r3, fill_unaligned
+    ld $0x10000000, %r1
+    ld $0x10002004, %r3
+    call checksum
+    st %r10, [%r13 + 0]
+    add %r5, %r13
+
+    # copy to an unaligned address
+    ld $0x10000000, %r1
+    ld $0x10010002, %r2
+    ld $0x10002000, %r3
+copy_unaligned:
+    ld [%r1 + 0], %r4
+    st %r4, [%r2 + 0]
+    add %r5, %r1
+    add %r5, %r2
+    bne %r1, %r3, copy_unaligned
+    ld $0x10010000, %r1
+    ld $0x10012004, %r3
+    call checksum
+    st %r10, [%r13 + 0]
+    add %r5, %r13
+
+    # compare of equal ranges runs to the end
+    ld $0x10000000, %r1
+    ld $0x10010002, %r2
+    ld $0x10001000, %r3
+    call compare
+    # word stored to an unaligned address changes two words, compare leaves the loop at the first of them
+    ld $0x10000a36, %r1
+    ld $0x5a, %r2
+    st %r2, [%r1 + 0]
+    ld $0x10000000, %r1
+    ld $0x10010002, %r2
+    ld $0x10001000, %r3
+    call compare
+
+    # overlapping copy to a higher address repeats the first two words, it is not a memmove
+    ld $0x10000000, %r1
+    ld $0x10000008, %r2
+    ld $0x10001000, %r3
+copy_up:
+    ld [%r1 + 0], %r4
+    st %r4, [%r2 + 0]
+    add %r5, %r1
+    add %r5, %r2
+    bne %r1, %r3, copy_up
+    ld $0x10000000, %r1
+    ld $0x10001008, %r3
+    call checksum
+    st %r10, [%r13 + 0]
+    add %r5, %r13
+
+    # overlapping copy to a lower address
+    ld $0x10010002, %r1
+    ld $0x1000fffc, %r2
+    ld $0x10011002, %r3
+copy_down:
+    ld [%r1 + 0], %r4
+    st %r4, [%r2 + 0]
+    add %r5, %r1
+    add %r5, %r2
+    bne %r1, %r3, copy_down
+    ld $0x1000fffc, %r1
+    ld $0x10011004, %r3
+    call checksum
+    st %r10, [%r13 + 0]
+    add %r5, %r13
+
+    # overlapping copy from the last word down to a higher address
+    ld $0x10010ffc, %r1
+    ld $0x10011004, %r2
+    ld $0x1000fffc, %r3
+copy_backward:
+    ld [%r1 + 0], %r4
+    st %r4, [%r2 + 0]
+    sub %r5, %r1
+    sub %r5, %r2
+    bne %r1, %r3, copy_backward
+    ld $0x1000fffc, %r1
+    ld $0x10011008, %r3
+    call checksum
+    st %r10, [%r13 + 0]
+    add %r5, %r13
+
+    # timer interrupts come in the middle of a long fill
+    ld $0, %r1
+    st %r1, timer_config
+    ld $0x10020000, %r1
+    ld $0x10060000, %r3
+    ld $0x5a5a5a5a, %r4
+fill_timer:
+    st %r4, [%r1 + 0]
+    add %r5, %r1
+    bne %r1, %r3, fill_timer
+    ld ticks, %r10
+    st %r10, [%r13 + 0]
+    add %r5, %r13
+    ld $0x10020000, %r1
+    ld $0x10060000, %r3
+    call checksum
+    st %r10, [%r13 + 0]
+    add %r5, %r13
+
+    # copy over code that has already run
+    call patched
+    st %r8, [%r13 + 0]
+    add %r5, %r13
+    ld $template, %r1
+    ld $patched, %r2
+    ld $template_end, %r3
+copy_code:
+    ld [%r1 + 0], %r4
+    st %r4, [%r2 + 0]
+    add %r5, %r1
+    add %r5, %r2
+    bne %r1, %r3, copy_code
+    call patched
+    st %r8, [%r13 + 0]
+    add %r5, %r13
+
+    ld $results, %r13
+    ld [%r13 + 0], %r1
+    ld [%r13 + 4], %r2
+    ld [%r13 + 8], %r3
+    ld [%r13 + 12], %r4
+    ld [%r13 + 16], %r5
+    ld [%r13 + 20], %r6
+    ld [%r13 + 24], %r7
+    ld [%r13 + 28], %r8
+    ld [%r13 + 32], %r9
+    ld [%r13 + 36], %r10
+    ld [%r13 + 40], %r11
+    ld [%r13 + 44], %r12
+    ld [%r13 + 48], %r13
+    halt
+
+# compares words from r1 and r2 on until r1 reaches r3, and saves the offset where it stopped and the difference of
+# the last two words
+compare:
+    ld [%r1 + 0], %r6
+    ld [%r2 + 0], %r7
+    bne %r6, %r7, compare_done
+    add %r5, %r1
+    add %r5, %r2
+    bne %r1, %r3, compare
+compare_done:
+    ld $0x10000000, %r2
+    sub %r2, %r1
+    st %r1, [%r13 + 0]
+    add %r5, %r13
+    sub %r7, %r6
+    st %r6, [%r13 + 0]
+    add %r5, %r13
+    ret
+
+# overwritten with the template
+patched:
+    ld $1, %r8
+    ld $2, %r9
+    add %r9, %r8
+    ret
+
+.end
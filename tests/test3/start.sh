@@ -0,0 +1,28 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+
+DIR=./tests/test3
+
+${ASSEMBLER} -o main.o ${DIR}/main.s
+${ASSEMBLER} -o checksum.o ${DIR}/checksum.s
+${ASSEMBLER} -o template.o ${DIR}/template.s
+${ASSEMBLER} -o handler.o ${DIR}/handler.s
+${ASSEMBLER} -o isr_timer.o ${DIR}/isr_timer.s
+${LINKER} -hex \
+  -place=code@0x40000000 \
+  -o program.hex \
+  main.o checksum.o template.o handler.o isr_timer.o
+
+# Emulator removes the program once it is loaded, so every run gets its own copy
+# Virtual timer makes interrupts come at the same instructions in both runs
+OPTIONS="-engine=block -timer=virtual -timer-rate=100"
+cp program.hex no_idioms.hex
+cp program.hex lockstep.hex
+${EMULATOR} ${OPTIONS} program.hex | grep "=0x" > idioms.txt
+${EMULATOR} ${OPTIONS} -no-loop-idioms no_idioms.hex | grep "=0x" > no_idioms.txt
+# Every compiled loop body is also interpreted and checked against its native run
+${EMULATOR} ${OPTIONS} -engine=jit -jit-lockstep -no-loop-idioms lockstep.hex | grep "=0x" > lockstep.txt
+cat idioms.txt
+diff idioms.txt no_idioms.txt && echo "loop idioms: same state as interpreted loops" &&
+  diff idioms.txt lockstep.txt && echo "jit lockstep: native blocks matched the interpreter"
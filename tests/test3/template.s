@@ -0,0 +1,12 @@
+.global template, template_end
+
+.section patch
+# copied over the code of patched
+template:
+    ld $0x70, %r8
+    ld $0x7, %r9
+    add %r9, %r8
+    ret
+template_end:
+
+.end
@@ -0,0 +1,18 @@
+.global host_call
+
+.equ host_regs, 0xFFFFFF80
+
+.section host
+# makes call r1 with arguments r2, r3 and r4, result is returned in r10
+host_call:
+    push %r12
+    ld $host_regs, %r12
+    st %r2, [%r12 + 4]
+    st %r3, [%r12 + 8]
+    st %r4, [%r12 + 12]
+    st %r1, [%r12 + 0]
+    ld [%r12 + 16], %r10
+    pop %r12
+    ret
+
+.end
@@ -0,0 +1,140 @@
+# Host calls, guest writes the arguments and the call number to the host call registers and reads back the result
+# Results and the words the calls wrote are stored to the results array and loaded to r1-r12 before halt, start.sh
+# checks them against the expected values on every engine
+
+.extern host_call, message, message_end, file_name, outside_name
+
+.equ initial_sp, 0xFFFFFEFE
+.equ results, 0x10070000
+.equ buffer, 0x10000000
+.equ file_buffer, 0x10010000
+
+.equ host_copy, 1
+.equ host_fill, 2
+.equ host_write, 3
+.equ host_read_file, 4
+
+.section code
+my_start:
+    ld $initial_sp, %sp
+    ld $results, %r13
+    ld $4, %r5
+
+    # r1, r2, r3 - fill starting at an unaligned address, and the words at its start and end
+    ld $host_fill, %r1
+    ld $0x10000003, %r2
+    ld $0x41424344, %r3
+    ld $0x400, %r4
+    call host_call
+    st %r10, [%r13 + 0]
+    ld $buffer, %r6
+    ld [%r6 + 4], %r7
+    st %r7, [%r13 + 4]
+    ld $0x10001000, %r6
+    ld [%r6 + 0], %r7
+    st %r7, [%r13 + 8]
+
+    # r4, r5 - overlapping copy to a higher address works as memmove, words at its start and end
+    ld $host_copy, %r1
+    ld $0x10000009, %r2
+    ld $0x10000003, %r3
+    ld $0x401, %r4
+    call host_call
+    ld $buffer, %r6
+    ld [%r6 + 8], %r7
+    st %r7, [%r13 + 12]
+    ld $0x10000408, %r6
+    ld [%r6 + 0], %r7
+    st %r7, [%r13 + 16]
+
+    # r6 - text goes to the terminal, result is its length
+    ld $host_write, %r1
+    ld $message, %r2
+    ld $message_end, %r3
+    sub %r2, %r3
+    call host_call
+    st %r10, [%r13 + 20]
+
+    # r7, r8 - files are read from the directory given with -host-dir, result is the number of bytes read
+    ld $host_read_file, %r1
+    ld $file_name, %r2
+    ld $file_buffer, %r3
+    ld $0x40, %r4
+    call host_call
+    st %r10, [%r13 + 24]
+    ld $file_buffer, %r6
+    ld [%r6 + 0], %r7
+    st %r7, [%r13 + 28]
+
+    # r9 - names can't lead out of the directory, even back into it
+    ld $host_read_file, %r1
+    ld $outside_name, %r2
+    ld $file_buffer, %r3
+    ld $0x40, %r4
+    call host_call
+    st %r10, [%r13 + 32]
+
+    # r10 - ranges that reach the memory mapped registers, and unknown calls, fail
+    ld $host_copy, %r1
+    ld $0xFFFFFF00, %r2
+    ld $0x10000000, %r3
+    ld $0x10, %r4
+    call host_call
+    ld %r10, %r11
+    ld $host_fill, %r1
+    ld $0x10000000, %r2
+    ld $0, %r3
+    ld $0x40000000, %r4
+    call host_call
+    and %r10, %r11
+    ld $host_write, %r1
+    ld $0xFFFFFFF0, %r2
+    ld $0x20, %r3
+    call host_call
+    and %r10, %r11
+    ld $9, %r1
+    call host_call
+    and %r10, %r11
+    st %r11, [%r13 + 36]
+
+    # r11, r12 - copy over code that has already run
+    call patched
+    st %r8, [%r13 + 40]
+    ld $host_copy, %r1
+    ld $patched, %r2
+    ld $template, %r3
+    ld $template_end, %r4
+    sub %r3, %r4
+    call host_call
+    call patched
+    st %r8, [%r13 + 44]
+
+    ld [%r13 + 0], %r1
+    ld [%r13 + 4], %r2
+    ld [%r13 + 8], %r3
+    ld [%r13 + 12], %r4
+    ld [%r13 + 16], %r5
+    ld [%r13 + 20], %r6
+    ld [%r13 + 24], %r7
+    ld [%r13 + 28], %r8
+    ld [%r13 + 32], %r9
+    ld [%r13 + 36], %r10
+    ld [%r13 + 40], %r11
+    ld [%r13 + 44], %r12
+    halt
+
+# overwritten with the template
+patched:
+    ld $1, %r8
+    ld $2, %r9
+    add %r9, %r8
+    ret
+
+template:
+    ld $0x70, %r8
+    ld $0x7, %r9
+    add %r9, %r8
+    ret
+template_end:
+
+.end
@@ -0,0 +1,36 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+
+DIR=./tests/test4
+
+${ASSEMBLER} -o main.o ${DIR}/main.s
+${ASSEMBLER} -o host_call.o ${DIR}/host_call.s
+${ASSEMBLER} -o strings.o ${DIR}/strings.s
+${LINKER} -hex \
+  -place=code@0x40000000 \
+  -o program.hex \
+  main.o host_call.o strings.o || exit 1
+
+# r1-r12 hold the call results and the words the calls wrote, see main.s
+cat > expected.txt <<END
+ r0=0x00000000    r1=0x00000000    r2=0x44414243    r3=0x00414243
+ r4=0x42434443    r5=0x44414441    r6=0x0000000b    r7=0x0000000a
+ r8=0x74736f68    r9=0xffffffff   r10=0xffffffff   r11=0x00000003
+r12=0x00000077   r13=0x10070000   r14=0xfffffefe   r15=0x4000016c
+END
+
+# Emulator removes the program once it is loaded, so every run gets its own copy
+# Block engine is also run without loop idioms
+STATUS=0
+for RUN in switch threaded block jit no_idioms; do
+  cp program.hex ${RUN}.hex
+  OPTIONS="-engine=${RUN}"
+  [ ${RUN} = no_idioms ] && OPTIONS="-engine=block -no-loop-idioms"
+  ${EMULATOR} ${OPTIONS} -host-dir=${DIR} ${RUN}.hex | grep "=0x" > ${RUN}.txt
+  diff expected.txt ${RUN}.txt > /dev/null || {
+    echo "host calls: ${RUN} ended with"; cat ${RUN}.txt; STATUS=1
+  }
+done
+[ ${STATUS} = 0 ] && echo "host calls: expected results on all engines"
+exit ${STATUS}
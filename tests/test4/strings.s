@@ -0,0 +1,12 @@
+.global message, message_end, file_name, outside_name
+
+.section strings
+message:
+  .ascii "host calls\n"
+message_end:
+file_name:
+  .ascii "input.txt\0"
+outside_name:
+  .ascii "../test4/input.txt\0"
+
+.end
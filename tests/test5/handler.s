@@ -0,0 +1,19 @@
+.extern isr_terminal
+
+.global handler
+.section my_handler
+handler:
+    push %r1
+    push %r2
+    csrrd %cause, %r1
+    ld $3, %r2
+    beq %r1, %r2, handle_terminal
+finish:
+    pop %r2
+    pop %r1
+    iret
+handle_terminal:
+    call isr_terminal
+    jmp finish
+
+.end
@@ -0,0 +1,35 @@
+.extern count, chars
+
+.global isr_terminal
+
+.equ term_in, 0xFFFFFF04
+
+.section isr
+# stores the character to chars[count], and waits a while so the next one is due before the handler returns
+isr_terminal:
+    push %r1
+    push %r2
+    push %r3
+    ld count, %r1
+    ld $4, %r2
+    mul %r2, %r1
+    ld $chars, %r2
+    add %r2, %r1
+    ld term_in, %r2
+    st %r2, [%r1 + 0]
+    ld count, %r1
+    ld $1, %r2
+    add %r2, %r1
+    st %r1, count
+    ld $100, %r1
+    ld $1, %r2
+    ld $0, %r3
+delay:
+    sub %r2, %r1
+    bne %r1, %r3, delay
+    pop %r3
+    pop %r2
+    pop %r1
+    ret
+
+.end
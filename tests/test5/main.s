@@ -0,0 +1,48 @@
+# Terminal input comes from input.txt, one character per terminal interrupt
+# Handler is still running when the next character is due, it has to wait until the handler returns
+# Characters are loaded to r1-r8 and their count to r9 before halt
+
+.global handler, count, chars
+
+.equ initial_sp, 0xFFFFFEFE
+.equ expected, 8
+
+.section code
+my_start:
+    ld $initial_sp, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+
+    # gives up after a while if characters were lost
+    ld $0x10000, %r10
+    ld $1, %r11
+    ld $expected, %r12
+wait:
+    sub %r11, %r10
+    beq %r10, %r0, done
+    ld count, %r1
+    bne %r1, %r12, wait
+done:
+    ld $chars, %r13
+    ld [%r13 + 0], %r1
+    ld [%r13 + 4], %r2
+    ld [%r13 + 8], %r3
+    ld [%r13 + 12], %r4
+    ld [%r13 + 16], %r5
+    ld [%r13 + 20], %r6
+    ld [%r13 + 24], %r7
+    ld [%r13 + 28], %r8
+    ld count, %r9
+    ld $0, %r10
+    ld $0, %r11
+    ld $0, %r12
+    ld $0, %r13
+    halt
+
+.section data
+count:
+.word 0
+chars:
+.skip 32
+
+.end
@@ -0,0 +1,46 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+TRACEDUMP=./tracedump
+
+DIR=./tests/test5
+
+${ASSEMBLER} -o main.o ${DIR}/main.s
+${ASSEMBLER} -o handler.o ${DIR}/handler.s
+${ASSEMBLER} -o isr_terminal.o ${DIR}/isr_terminal.s
+${LINKER} -hex \
+  -place=code@0x40000000 \
+  -o program.hex \
+  main.o handler.o isr_terminal.o || exit 1
+
+# r1-r8 hold the characters in the order they came, r9 their count
+cat > expected.txt <<END
+ r0=0x00000000    r1=0x00000061    r2=0x00000062    r3=0x00000063
+ r4=0x00000064    r5=0x00000065    r6=0x00000066    r7=0x00000067
+ r8=0x00000068    r9=0x00000008   r10=0x00000000   r11=0x00000000
+r12=0x00000000   r13=0x00000000   r14=0xfffffefe   r15=0x4000006c
+END
+
+# Emulator removes the program once it is loaded, so every run gets its own copy
+# Virtual timer makes characters come at the same instructions on every engine
+STATUS=0
+for RUN in switch threaded block jit; do
+  cp program.hex ${RUN}.hex
+  ${EMULATOR} -engine=${RUN} -timer=virtual -input=${DIR}/input.txt -input-interval=50 ${RUN}.hex | grep "=0x" > ${RUN}.txt
+  diff expected.txt ${RUN}.txt > /dev/null || {
+    echo "terminal input: ${RUN} ended with"; cat ${RUN}.txt; STATUS=1
+  }
+done
+[ ${STATUS} = 0 ] && echo "terminal input: all characters read on all engines"
+
+# Trace has every instruction the emulator executed and every interrupt it accepted, one per character
+cp program.hex trace.hex
+EXECUTED=$(${EMULATOR} -timer=virtual -input=${DIR}/input.txt -input-interval=50 -trace=program.trace trace.hex |
+  sed -n 's/^Performance: \([0-9]*\) instructions.*/\1/p')
+SUMMARY=$(${TRACEDUMP} -summary program.trace)
+rm -f program.trace
+[ "${SUMMARY}" = "Trace: ${EXECUTED} instructions, 8 interrupts" ] || {
+  echo "trace: emulator executed ${EXECUTED} instructions, tracedump found"; echo "${SUMMARY}"; STATUS=1
+}
+[ ${STATUS} = 0 ] && echo "trace: tracedump found every executed instruction"
+exit ${STATUS}
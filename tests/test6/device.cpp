@@ -0,0 +1,43 @@
+#include "../../inc/emulator/Emulator.hpp"
+
+#include <iostream>
+#include <iomanip>
+
+// Status register reads 0 until the device was polled ready_after times
+#define READY_AFTER 5000
+
+static uint32_t statusRead(void* context, uint32_t) {
+  uint32_t* polls = (uint32_t*)context;
+  return ++*polls > READY_AFTER ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+  if ( argc != 3 ) {
+    std::cout << "usage: device <switch|threaded|block|jit> <input-file>" << std::endl;
+    return -1;
+  }
+
+  std::string engine = argv[1];
+  uint32_t polls = 0;
+  Emulator emulator;
+  if ( engine == "threaded" ) emulator.setEngine(ENGINE_THREADED);
+  else if ( engine == "block" ) emulator.setEngine(ENGINE_BLOCK);
+  else if ( engine == "jit" ) emulator.setEngine(ENGINE_JIT);
+  emulator.setVirtualTimer(true);
+  emulator.setHeadless(true);
+  if ( !emulator.loadExecutable(argv[2]) ) {
+    std::cout << emulator.getError() << std::endl;
+    return -1;
+  }
+  if ( !emulator.attachDevice({ "status", 0xFFFFFF40, 4, &polls, statusRead, nullptr }) ) {
+    std::cout << "Device could not be attached" << std::endl;
+    return -1;
+  }
+
+  emulator.run();
+  std::cout << std::hex << std::setfill('0');
+  std::cout << "r1=0x" << std::setw(8) << emulator.getRegister(1) << std::endl;
+  std::cout << "r3=0x" << std::setw(8) << emulator.getRegister(3) << std::endl;
+  std::cout << "polls=0x" << std::setw(8) << polls << std::endl;
+  return 0;
+}
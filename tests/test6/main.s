@@ -0,0 +1,16 @@
+# Polls a status register of a device the test attaches through the library interface
+# Loop has no stores and keeps every register the same, only the value read from the device changes
+# Status is loaded to r1 before halt
+
+.equ status, 0xFFFFFF40
+
+.section code
+my_start:
+    ld $status, %r3
+poll:
+    ld [%r3 + 0], %r1
+    beq %r1, %r0, poll
+    ld $0, %r3
+    halt
+
+.end
@@ -0,0 +1,33 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+
+DIR=./tests/test6
+
+${ASSEMBLER} -o main.o ${DIR}/main.s
+${LINKER} -hex \
+  -place=code@0x40000000 \
+  -o program.hex \
+  main.o || exit 1
+
+# Only a device attached through the library interface has a read callback, so the test builds its own host
+g++ -pthread -g -o device ${DIR}/device.cpp $(ls ./src/emulator/*.cpp | grep -v main.cpp) ./src/elf/*.cpp ./src/Helper.cpp || exit 1
+
+# Device is ready after 5000 reads of its status, the loop polls once more to see it
+cat > expected.txt <<END
+r1=0x00000001
+r3=0x00000000
+polls=0x00001389
+END
+
+# Idle skip must not take the polling loop for an idle one, timeout ends a run that waits for an event forever
+STATUS=0
+for RUN in switch threaded block jit; do
+  cp program.hex ${RUN}.hex
+  timeout 10 ./device ${RUN} ${RUN}.hex > ${RUN}.txt
+  diff expected.txt ${RUN}.txt > /dev/null || {
+    echo "device polling: ${RUN} ended with"; cat ${RUN}.txt; STATUS=1
+  }
+done
+rm -f device
+[ ${STATUS} = 0 ] && echo "device polling: device became ready on all engines"
+exit ${STATUS}
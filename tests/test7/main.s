@@ -0,0 +1,13 @@
+# Writes "OK" to the terminal and halts, batch jobs around it fail before they can run
+
+.equ term_out, 0xFFFFFF00
+
+.section code
+my_start:
+    ld $0x4F, %r1
+    st %r1, term_out
+    ld $0x4B, %r1
+    st %r1, term_out
+    halt
+
+.end
@@ -0,0 +1,39 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+
+DIR=./tests/test7
+
+${ASSEMBLER} -o main.o ${DIR}/main.s
+${LINKER} -hex \
+  -place=code@0x40000000 \
+  -o program.hex \
+  main.o || exit 1
+
+# Jobs that can't be loaded, or whose files can't be opened, fail without stopping the others
+cat > jobs.txt <<END
+program.hex - batch_out.txt
+missing.hex
+program.hex missing.txt
+program.hex - ./missing/batch_out.txt
+${DIR}/main.s
+program.hex
+END
+
+cat > expected.txt <<END
+batch: program.hex: halted after 5 instructions, 2 bytes of output(hash 0x85e4b82f)
+batch: missing.hex: error : file 'missing.hex' is not executable
+batch: program.hex < missing.txt: error : could not read input file 'missing.txt'
+batch: program.hex: error : could not write output file './missing/batch_out.txt'
+batch: ${DIR}/main.s: error : file '${DIR}/main.s' is not executable
+batch: program.hex: halted after 5 instructions, 2 bytes of output(hash 0x85e4b82f)
+Batch: 6 programs on 2 workers, 2 halted, 0 stopped at the limit, 4 failed
+END
+
+STATUS=0
+${EMULATOR} -batch=jobs.txt -jobs=2 | sed 's/, [0-9.]* s$//' > batch.txt
+diff expected.txt batch.txt > /dev/null || { echo "batch: results were"; cat batch.txt; STATUS=1; }
+[ "$(cat batch_out.txt)" = "OK" ] || { echo "batch: output file has '$(cat batch_out.txt)'"; STATUS=1; }
+rm -f jobs.txt batch.txt batch_out.txt
+[ ${STATUS} = 0 ] && echo "batch: failed jobs reported, the others ran"
+exit ${STATUS}
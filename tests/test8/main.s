@@ -0,0 +1,31 @@
+# Waits for timer interrupts with wfi, the timer is the only thing that can wake the processor up
+# Handler counts ticks, main loop counts how many times wfi returned, both end up in r1 and r2 before halt
+
+.global handler, ticks
+
+.equ initial_sp, 0xFFFFFEFE
+.equ expected, 3
+
+.section code
+my_start:
+    ld $initial_sp, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+
+    ld $0, %r2
+    ld $1, %r3
+    ld $expected, %r4
+sleep:
+    wfi
+    add %r3, %r2
+    ld ticks, %r1
+    bne %r1, %r4, sleep
+    ld $0, %r3
+    ld $0, %r4
+    halt
+
+.section data
+ticks:
+.word 0
+
+.end
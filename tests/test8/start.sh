@@ -0,0 +1,32 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+
+DIR=./tests/test8
+
+${ASSEMBLER} -o main.o ${DIR}/main.s
+${ASSEMBLER} -o handler.o ${DIR}/handler.s
+${LINKER} -hex \
+  -place=code@0x40000000 \
+  -o program.hex \
+  main.o handler.o || exit 1
+
+# r1 holds the timer ticks, r2 the number of times wfi returned, one per tick
+cat > expected.txt <<END
+ r0=0x00000000    r1=0x00000003    r2=0x00000003    r3=0x00000000
+ r4=0x00000000    r5=0x00000000    r6=0x00000000    r7=0x00000000
+ r8=0x00000000    r9=0x00000000   r10=0x00000000   r11=0x00000000
+r12=0x00000000   r13=0x00000000   r14=0xfffffefe   r15=0x40000038
+END
+
+# Virtual timer skips the time wfi sleeps, so the ticks come at the same instructions on every engine
+STATUS=0
+for RUN in switch threaded block jit; do
+  cp program.hex ${RUN}.hex
+  ${EMULATOR} -engine=${RUN} -timer=virtual -headless ${RUN}.hex | grep "=0x" > ${RUN}.txt
+  diff expected.txt ${RUN}.txt > /dev/null || {
+    echo "wait for interrupt: ${RUN} ended with"; cat ${RUN}.txt; STATUS=1
+  }
+done
+[ ${STATUS} = 0 ] && echo "wait for interrupt: woken by every tick on all engines"
+exit ${STATUS}
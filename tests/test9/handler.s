@@ -0,0 +1,22 @@
+.extern ticks
+
+.global handler
+.section my_handler
+handler:
+    push %r1
+    push %r2
+    csrrd %cause, %r1
+    ld $2, %r2
+    beq %r1, %r2, handle_timer
+finish:
+    pop %r2
+    pop %r1
+    iret
+handle_timer:
+    ld ticks, %r1
+    ld $1, %r2
+    add %r2, %r1
+    st %r1, ticks
+    jmp finish
+
+.end
@@ -0,0 +1,38 @@
+# Halts after two timer ticks, and once it is resumed from the snapshot taken at that halt, after two more
+# Ticks are counted in memory and wfi wakeups in r2, so both have to survive the snapshot with the timer state
+
+.global handler, ticks
+
+.equ initial_sp, 0xFFFFFEFE
+
+.section code
+my_start:
+    ld $initial_sp, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+
+    ld $0, %r2
+    ld $1, %r3
+    ld $2, %r4
+first:
+    wfi
+    add %r3, %r2
+    ld ticks, %r1
+    bne %r1, %r4, first
+    halt
+
+    ld $4, %r4
+second:
+    wfi
+    add %r3, %r2
+    ld ticks, %r1
+    bne %r1, %r4, second
+    ld $0, %r3
+    ld $0, %r4
+    halt
+
+.section data
+ticks:
+.word 0
+
+.end
@@ -0,0 +1,43 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+
+DIR=./tests/test9
+
+${ASSEMBLER} -o main.o ${DIR}/main.s
+${ASSEMBLER} -o handler.o ${DIR}/handler.s
+${LINKER} -hex \
+  -place=code@0x40000000 \
+  -o program.hex \
+  main.o handler.o || exit 1
+
+# First run halts after two ticks, r1 holds the ticks and r2 the number of times wfi returned
+cat > expected_saved.txt <<END
+ r0=0x00000000    r1=0x00000002    r2=0x00000002    r3=0x00000001
+ r4=0x00000002    r5=0x00000000    r6=0x00000000    r7=0x00000000
+ r8=0x00000000    r9=0x00000000   r10=0x00000000   r11=0x00000000
+r12=0x00000000   r13=0x00000000   r14=0xfffffefe   r15=0x40000030
+END
+
+# Run resumed from the snapshot continues after the halt, up to the fourth tick
+cat > expected.txt <<END
+ r0=0x00000000    r1=0x00000004    r2=0x00000004    r3=0x00000000
+ r4=0x00000000    r5=0x00000000    r6=0x00000000    r7=0x00000000
+ r8=0x00000000    r9=0x00000000   r10=0x00000000   r11=0x00000000
+r12=0x00000000   r13=0x00000000   r14=0xfffffefe   r15=0x40000054
+END
+
+# Snapshot saved by each engine is loaded by the same engine
+STATUS=0
+for RUN in switch threaded block jit; do
+  cp program.hex ${RUN}.hex
+  ${EMULATOR} -engine=${RUN} -timer=virtual -headless -save-snapshot=${RUN}.snap ${RUN}.hex | grep "=0x" > ${RUN}_saved.txt
+  ${EMULATOR} -engine=${RUN} -timer=virtual -headless -load-snapshot=${RUN}.snap | grep "=0x" > ${RUN}.txt
+  diff expected_saved.txt ${RUN}_saved.txt > /dev/null && diff expected.txt ${RUN}.txt > /dev/null || {
+    echo "snapshot: ${RUN} halted with"; cat ${RUN}_saved.txt; echo "and resumed to"; cat ${RUN}.txt; STATUS=1
+  }
+  rm -f ${RUN}.snap ${RUN}_saved.txt
+done
+rm -f expected_saved.txt
+[ ${STATUS} = 0 ] && echo "snapshot: resumed runs ended the same on all engines"
+exit ${STATUS}